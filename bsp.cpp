@@ -1,16 +1,36 @@
 #include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <random>
 #include <stack>
+#include <unordered_set>
+#include <stdexcept>
+#include <utility>
 #include <algorithm>
 #include <iomanip>
 #include <ostream>
+#include <sstream>
 
 #include <CGAL/enum.h>
 
 #include "bsp.h"
-
-struct PointInPolyhedron;
-class InternalNode;
-class LeafNode;
+#include "parallel.h"
+
+template <class Kernel> struct PointInPolyhedron;
+struct Packet;
+struct SplitCounts;
+struct SplitCandidate;
+template <class Kernel> class InternalNode;
+template <class Kernel> class LeafNode;
+template <class Kernel> struct InsertBatch;
+template <class Kernel> struct LinePart;
+template <class Kernel> class BoxRegion;
+template <class Kernel> class HalfspaceRegion;
 
 enum OrientedSide {
     ON_NEGATIVE_SIDE = 1 << 1, // CGAL::ON_NEGATIVE_SIDE,
@@ -18,415 +38,3459 @@ enum OrientedSide {
     ON_POSITIVE_SIDE = 1 << 3, // CGAL::ON_POSITIVE_SIDE,
 };
 
-int oriented_side(const Plane_3&, const Polyhedron_3&);
-Node* split(const Polyhedron_3&, const Polyhedron_3&);
-Node* create_node(const std::vector<Polyhedron_3>&);
-std::ostream& print(std::ostream&, Node*, int);
+// CellStore<Kernel>::Index
+typedef std::size_t Index;
+
+template <class Kernel>
+int oriented_side(const typename Kernel::Plane_3&, const BasicPolyhedron_3<Kernel>&);
+template <class Kernel>
+int oriented_side(const typename Kernel::Plane_3&, const FilteredPlane&, const Cell<Kernel>&);
+template <class Plane, class Point>
+CGAL::Oriented_side oriented_side(const FilteredPlane&, const Plane&,
+        const FilteredPoint&, const Point&);
+template <class Plane, class Point, class Counters>
+CGAL::Oriented_side oriented_side(const FilteredPlane&, const Plane&,
+        const FilteredPoint&, const Point&, Counters&);
+template <class Kernel, class Counters>
+bool cell_contains(const Cell<Kernel>&, const typename Kernel::Point_3&, const FilteredPoint&, Counters&);
+template <class Kernel, class Counters>
+const BasicPolyhedron_3<Kernel>* locate_point(const CellStore<Kernel>&, Node<Kernel>*,
+        const typename Kernel::Point_3&, Counters&);
+template <class Kernel, class Counters>
+const BasicPolyhedron_3<Kernel>* locate_hinted(const CellStore<Kernel>&, Node<Kernel>*,
+        const typename Kernel::Point_3&, const BasicPolyhedron_3<Kernel>*, Counters&);
+template <class Kernel>
+double outside_distance(const Cell<Kernel>&, const FilteredPoint&, std::size_t&);
+template <class Kernel>
+void plane_along(const typename Kernel::Plane_3&, const LinePart<Kernel>&, typename Kernel::FT&,
+        typename Kernel::FT&);
+template <class Kernel>
+bool clip(const Cell<Kernel>&, const LinePart<Kernel>&, typename Kernel::FT&, typename Kernel::FT&, bool&);
+template <class Kernel, class Visit>
+bool trace_node(Node<Kernel>*, const LinePart<Kernel>&, const typename Kernel::FT&,
+        const typename Kernel::FT&, bool, Visit&);
+template <class Kernel>
+bool meets(const CellStore<Kernel>&, Index, const LinePart<Kernel>&, const typename Kernel::FT&,
+        const typename Kernel::FT&, bool, typename BasicBSPTree<Kernel>::Hit&);
+template <class Kernel, class Region>
+void range_node(const CellStore<Kernel>&, Node<Kernel>*, const Region&, std::unordered_set<Index>&,
+        const std::function<void(int)>&);
+template <class Kernel>
+std::vector<typename BasicBSPTree<Kernel>::Hit> trace_line(const CellStore<Kernel>&, Node<Kernel>*,
+        const LinePart<Kernel>&);
+template <class Kernel>
+bool first_hit_line(const CellStore<Kernel>&, Node<Kernel>*, const LinePart<Kernel>&,
+        typename BasicBSPTree<Kernel>::Hit&);
+bool on_boundary(int);
+template <class Plane>
+void cache_exact(const Plane&);
+void cache_exact(const Epeck::Plane_3&);
+void cache_exact(const Epeck::Point_3&);
+template <class Kernel>
+void locate_packet(const CellStore<Kernel>&, Node<Kernel>*, Packet&, std::size_t, std::size_t,
+        const typename Kernel::Point_3*, int*);
+template <class Kernel>
+Node<Kernel>* split(const CellStore<Kernel>&, NodePool<Kernel>&, Index, Index);
+template <class Kernel>
+int separating_halfspace(const Cell<Kernel>&, const Cell<Kernel>&, std::size_t&);
+template <class Kernel>
+void classify_insert(const CellStore<Kernel>&, Node<Kernel>*, std::vector<Index>&,
+        std::vector<std::pair<InternalNode<Kernel>*, Index> >&, std::vector<InsertBatch<Kernel> >&);
+template <class Kernel>
+void touch(InternalNode<Kernel>*);
+template <class Kernel>
+Node<Kernel>* rebalance(const CellStore<Kernel>&, NodePool<Kernel>&, Node<Kernel>*, const BuildOptions&, unsigned);
+template <class Kernel>
+Node<Kernel>* remove_batch(const CellStore<Kernel>&, NodePool<Kernel>&, Node<Kernel>*, const std::vector<Index>&);
+template <class Kernel>
+Node<Kernel>* create_node(const CellStore<Kernel>&, NodePool<Kernel>&, const std::vector<Index>&,
+        const BuildOptions&, std::uint64_t, unsigned);
+template <class Kernel>
+std::vector<const typename Kernel::Plane_3*> split_candidates(const CellStore<Kernel>&, const std::vector<Index>&,
+        const BuildOptions&, std::uint64_t);
+template <class Kernel>
+std::vector<SplitCandidate> score_candidates(const CellStore<Kernel>&, const std::vector<Index>&,
+        const std::vector<const typename Kernel::Plane_3*>&, const BuildOptions&, unsigned);
+double split_score(const SplitCounts&, const BuildOptions&);
+template <class Kernel>
+bool partition(const CellStore<Kernel>&, const std::vector<Index>&, const typename Kernel::Plane_3&,
+        std::vector<Index>&, std::vector<Index>&, std::vector<Index>&);
+std::uint64_t mix_seed(std::uint64_t, std::uint64_t);
+template <class Kernel>
+std::ostream& print(std::ostream&, const CellStore<Kernel>&, Node<Kernel>*, int);
+
+// Counter policies of the point location code. Queries without statistics
+// use NoQueryCounters, whose calls compile to nothing.
+struct NoQueryCounters {
+    void plane() {}
+    void exact() {}
+    void containment() {}
+    void hint() {}
+    void hint_hit() {}
+    void walk_hit() {}
+};
+
+struct QueryCounters {
+    QueryStats &stats;
+
+    QueryCounters(QueryStats &_stats) : stats(_stats) {}
+
+    void plane() {
+        ++stats.planes;
+    }
+
+    void exact() {
+        ++stats.exact;
+    }
+
+    void containment() {
+        ++stats.containment;
+    }
+
+    void hint() {
+        ++stats.hinted;
+    }
+
+    void hint_hit() {
+        ++stats.hint_hits;
+    }
+
+    void walk_hit() {
+        ++stats.walk_hits;
+    }
+};
 
+template <class Kernel>
 struct PointInPolyhedron {
-    Point_3 p;
+    const CellStore<Kernel> &store;
+    const typename Kernel::Point_3 &p;
+    const FilteredPoint &fp;
 
-    PointInPolyhedron(const Point_3 &_p)
-        : p(_p) {}
+    PointInPolyhedron(const CellStore<Kernel> &_store, const typename Kernel::Point_3 &_p, const FilteredPoint &_fp)
+        : store(_store), p(_p), fp(_fp) {}
 
-    bool operator()(const Polyhedron_3 &poly) {
-        return point_in_polyhedron(poly, p);
+    bool operator()(Index cell) {
+        return store.cell(cell).contains(p, fp);
     }
 };
 
-// CLASS Polyhedron_3
+// Query points of locate_batch() in structure-of-arrays form. Entries are
+// reordered in place as the packet is split between subtrees.
+struct Packet {
+    std::vector<double> x, y, z;
+    std::vector<std::size_t> index;
+    std::vector<int> side;
+
+    Packet(std::size_t size)
+        : x(size), y(size), z(size), index(size), side(size) {}
+
+    void swap(std::size_t i, std::size_t j) {
+        std::swap(x[i], x[j]);
+        std::swap(y[i], y[j]);
+        std::swap(z[i], z[j]);
+        std::swap(index[i], index[j]);
+        std::swap(side[i], side[j]);
+    }
+};
 
-int Polyhedron_3::_max_id = 0;
+const std::size_t PACKET_SIZE = 256;
 
-Polyhedron_3::Polyhedron_3()
-        : _id(_max_id++) {}
+// Steps a hinted query walks across facets before it descends from the root.
+const std::size_t HINT_WALK_STEPS = 8;
 
-Polyhedron_3::Polyhedron_3(const CGALPolyhedron_3 &poly)
-        : CGALPolyhedron_3(poly), _id(_max_id++) {}
+// Nodes with fewer cells are built by a single thread.
+const std::size_t PARALLEL_BUILD_GRAIN = 1024;
 
-bool Polyhedron_3::operator==(const Polyhedron_3 &other) const {
-    return other._id == _id;
+// How the cells of a node distribute over a candidate plane. Cells cut by
+// the plane are counted on both sides.
+struct SplitCounts {
+    std::size_t left, right, straddle;
+    double left_volume, right_volume;
+
+    SplitCounts()
+        : left(0), right(0), straddle(0), left_volume(0), right_volume(0) {}
+
+    // Both subtrees have to be smaller than the node, or the recursion
+    // would not terminate.
+    bool divides(std::size_t size) const {
+        return left && left < size && right && right < size;
+    }
+};
+
+// A candidate plane n . x = offset scaled to a unit normal whose first
+// non-zero coordinate is positive, so that parallel planes compare equal
+// in their normals and can share one sweep over the cells.
+struct SplitCandidate {
+    double nx, ny, nz, offset;
+    // index into the planes passed to score_candidates()
+    std::size_t plane;
+    SplitCounts counts;
+    double score;
+
+    bool parallel(const SplitCandidate &other) const {
+        return nx == other.nx && ny == other.ny && nz == other.nz;
+    }
+};
+
+// Cells of a bulk insert that reached the same leaf, and the subtree built
+// from them and the cell of the leaf.
+template <class Kernel>
+struct InsertBatch {
+    LeafNode<Kernel> *leaf;
+    std::vector<Index> cells;
+    Node<Kernel> *subtree;
+};
+
+// The points source + t * v of a ray or segment: t >= 0 for a ray, t in
+// [0, 1] for a segment.
+template <class Kernel>
+struct LinePart {
+    typename Kernel::Point_3 source;
+    typename Kernel::Vector_3 v;
+    bool bounded;
+
+    LinePart(const typename Kernel::Ray_3 &ray)
+        : source(ray.source()), v(ray.to_vector()), bounded(false) {}
+    LinePart(const typename Kernel::Segment_3 &segment)
+        : source(segment.source()), v(segment.to_vector()), bounded(true) {}
+};
+
+// Sign of a * d - b * c in exact arithmetic; the doubles of Epick are
+// converted to rationals first.
+template <class FT>
+int exact_determinant_sign(const FT &a, const FT &b, const FT &c, const FT &d) {
+    FT ad = a * d, bc = b * c;
+    return (bc < ad) - (ad < bc);
 }
 
-bool Polyhedron_3::operator<(const Polyhedron_3 &other) const {
-    return _id < other._id;
+int exact_determinant_sign(double a, double b, double c, double d) {
+    return exact_determinant_sign(CGAL::Gmpq(a), CGAL::Gmpq(b), CGAL::Gmpq(c), CGAL::Gmpq(d));
 }
 
-int Polyhedron_3::id() const {
-    return _id;
+// The same, filtered in doubles as FilteredPlane does.
+template <class FT>
+int determinant_sign(const FT &a, const FT &b, const FT &c, const FT &d) {
+    double ad = CGAL::to_double(a) * CGAL::to_double(d),
+           bc = CGAL::to_double(b) * CGAL::to_double(c),
+           bound = FilteredPlane::EPS * (std::fabs(ad) + std::fabs(bc));
+    if (bound > FilteredPlane::MIN_MAGNITUDE && std::fabs(ad - bc) > bound)
+        return ad > bc ? 1 : -1;
+    return exact_determinant_sign(a, b, c, d);
 }
 
-// CLASS Node
+// Query regions of BasicBSPTree::range(). side() returns the side mask of
+// the region with respect to a splitting plane and meets() whether the
+// region meets a cell; both count boundaries as inside.
 
-class Node {
-    public:
-        InternalNode *parent;
+// CLASS BoxRegion
 
-        virtual ~Node() {}
-        virtual bool has_children() = 0;
-    protected:
-        Node(InternalNode *_parent = NULL) : parent(_parent) {}
-};
+template <class Kernel>
+class BoxRegion {
+    typedef typename Kernel::FT FT;
+    typedef typename Kernel::Point_3 Point_3;
+    typedef typename Kernel::Vector_3 Vector_3;
+
+    const typename Kernel::Iso_cuboid_3 &box;
+    // corner i takes the maximum in x if i & 1, in y if i & 2, in z if i & 4
+    std::vector<Point_3> corners;
+    std::vector<FilteredPoint> fcorners;
+    double lo[3], hi[3];
+
+    // the corner where a plane with these coefficients is lowest
+    static int lowest(const FilteredPlane &plane) {
+        return (plane.a > 0 ? 0 : 1) | (plane.b > 0 ? 0 : 2) | (plane.c > 0 ? 0 : 4);
+    }
+
+    // Whether every vertex lies below the bound in coordinate i if side < 0,
+    // or above it otherwise.
+    static bool beyond(const BasicPolyhedron_3<Kernel> &poly, int i, const FT &bound, int side) {
+        for (auto p = poly.points_begin(); p != poly.points_end(); ++p) {
+            if (side < 0 ? !(p->cartesian(i) < bound) : !(bound < p->cartesian(i)))
+                return false;
+        }
+        return true;
+    }
 
-class InternalNode : public Node {
     public:
-        Node *left, *right;
-        Plane_3 plane;
-        std::set<Polyhedron_3> polys;
 
-        InternalNode(Node *_left, Node *_right, const Plane_3 &_plane, std::set<Polyhedron_3> _polys, InternalNode *_parent = NULL)
-                : Node(_parent), left(_left), right(_right), plane(_plane), polys(_polys) {
-            left->parent = this;
-            right->parent = this;
+        BoxRegion(const typename Kernel::Iso_cuboid_3 &_box) : box(_box) {
+            for (int i = 0; i < 8; ++i) {
+                corners.push_back(Point_3(i & 1 ? box.xmax() : box.xmin(),
+                                          i & 2 ? box.ymax() : box.ymin(),
+                                          i & 4 ? box.zmax() : box.zmin()));
+                fcorners.push_back(FilteredPoint(corners.back()));
+            }
+            lo[0] = fcorners[0].x; lo[1] = fcorners[0].y; lo[2] = fcorners[0].z;
+            hi[0] = fcorners[7].x; hi[1] = fcorners[7].y; hi[2] = fcorners[7].z;
+        }
+
+        int side(const InternalNode<Kernel> &node) const {
+            int low = lowest(node.fplane);
+            if (oriented_side(node.fplane, node.plane, fcorners[low], corners[low]) == CGAL::ON_POSITIVE_SIDE)
+                return ON_POSITIVE_SIDE;
+            if (oriented_side(node.fplane, node.plane, fcorners[7 - low], corners[7 - low]) == CGAL::ON_NEGATIVE_SIDE)
+                return ON_NEGATIVE_SIDE;
+            return ON_NEGATIVE_SIDE | ON_POSITIVE_SIDE;
         }
 
-        bool has_children() {
+        // Tests the axes of the box, the facet planes of the cell and the
+        // cross products of its edges with the axes for a separating plane,
+        // after cheaper tests that settle most cells.
+        bool meets(const Cell<Kernel> &cell) const {
+            // rounding is monotone, so boxes apart in doubles are apart;
+            // boxes only touching in doubles may still be apart exactly
+            for (int i = 0; i < 3; ++i) {
+                if (cell.hi[i] < lo[i] || hi[i] < cell.lo[i])
+                    return false;
+                if ((cell.hi[i] == lo[i] && beyond(cell.poly, i, box.min_coord(i), -1)) ||
+                        (cell.lo[i] == hi[i] && beyond(cell.poly, i, box.max_coord(i), 1)))
+                    return false;
+            }
+
+            const BasicPolyhedron_3<Kernel> &poly = cell.poly;
+            for (auto p = poly.points_begin(); p != poly.points_end(); ++p) {
+                if (box.xmin() <= p->x() && p->x() <= box.xmax() &&
+                        box.ymin() <= p->y() && p->y() <= box.ymax() &&
+                        box.zmin() <= p->z() && p->z() <= box.zmax())
+                    return true;
+            }
+
+            for (std::size_t i = 0; i < cell.halfspaces.size(); ++i) {
+                const FilteredPlane &fplane = cell.fhalfspaces[i];
+                int low = lowest(fplane);
+                if (oriented_side(fplane, cell.halfspaces[i], fcorners[low], corners[low]) == CGAL::ON_POSITIVE_SIDE)
+                    return false;
+            }
+
+            for (auto h = poly.halfedges_begin(); h != poly.halfedges_end(); ++h) {
+                // every edge once
+                if (&*h > &*h->opposite())
+                    continue;
+
+                Vector_3 d = h->vertex()->point() - h->opposite()->vertex()->point();
+                Vector_3 axes[3] = {
+                    Vector_3(0, d.z(), -d.y()),
+                    Vector_3(-d.z(), 0, d.x()),
+                    Vector_3(d.y(), -d.x(), 0)
+                };
+                for (const Vector_3 &w : axes) {
+                    if (w.x() == 0 && w.y() == 0 && w.z() == 0)
+                        continue;
+
+                    FT box_min = 0, box_max = 0;
+                    for (int i = 0; i < 3; ++i) {
+                        FT a = w[i] * box.min_coord(i), b = w[i] * box.max_coord(i);
+                        box_min += std::min(a, b);
+                        box_max += std::max(a, b);
+                    }
+
+                    auto p = poly.points_begin();
+                    FT cell_min = w.x() * p->x() + w.y() * p->y() + w.z() * p->z(), cell_max = cell_min;
+                    for (++p; p != poly.points_end(); ++p) {
+                        FT value = w.x() * p->x() + w.y() * p->y() + w.z() * p->z();
+                        cell_min = std::min(cell_min, value);
+                        cell_max = std::max(cell_max, value);
+                    }
+                    if (cell_max < box_min || box_max < cell_min)
+                        return false;
+                }
+            }
             return true;
         }
 };
 
-class LeafNode : public Node {
+// CLASS HalfspaceRegion
+
+template <class Kernel>
+class HalfspaceRegion {
+    typedef typename Kernel::FT FT;
+    typedef typename Kernel::Point_3 Point_3;
+    typedef typename Kernel::Plane_3 Plane_3;
+
+    const Plane_3 &plane;
+    FilteredPlane fplane;
+    // the coefficient of the largest magnitude among a, b and c
+    int axis;
+
+    static auto coefficient(const Plane_3 &plane, int i) -> decltype(plane.a()) {
+        return i == 0 ? plane.a() : i == 1 ? plane.b() : plane.c();
+    }
+
     public:
-        Polyhedron_3 poly;
 
-        LeafNode(const Polyhedron_3 &_poly, InternalNode *_parent = NULL)
-            : Node(_parent), poly(_poly) {}
+        HalfspaceRegion(const Plane_3 &_plane) : plane(_plane), fplane(_plane) {
+            double a = std::fabs(fplane.a), b = std::fabs(fplane.b), c = std::fabs(fplane.c);
+            axis = a >= b && a >= c ? 0 : b >= c ? 1 : 2;
+        }
+
+        // Only a splitting plane parallel to the region's plane can have the
+        // whole region on one side.
+        int side(const InternalNode<Kernel> &node) const {
+            const FilteredPlane &n = node.fplane;
+            double cx = n.b * fplane.c - n.c * fplane.b,
+                   cy = n.c * fplane.a - n.a * fplane.c,
+                   cz = n.a * fplane.b - n.b * fplane.a,
+                   norms = (n.a * n.a + n.b * n.b + n.c * n.c) *
+                           (fplane.a * fplane.a + fplane.b * fplane.b + fplane.c * fplane.c);
+            if (cx * cx + cy * cy + cz * cz > 1e-18 * norms)
+                return ON_NEGATIVE_SIDE | ON_POSITIVE_SIDE;
+
+            const Plane_3 &h = node.plane;
+            // doubles cannot certify zero
+            if (exact_determinant_sign(h.b(), h.c(), plane.b(), plane.c()) ||
+                    exact_determinant_sign(h.c(), h.a(), plane.c(), plane.a()) ||
+                    exact_determinant_sign(h.a(), h.b(), plane.a(), plane.b()))
+                return ON_NEGATIVE_SIDE | ON_POSITIVE_SIDE;
+
+            // h = k * plane + e with k = h[axis] / plane[axis], so the
+            // splitting plane takes the value e on the region's plane and
+            // the region extends from there towards its negative side if k
+            // is positive
+            const FT &p = coefficient(plane, axis), &q = coefficient(h, axis);
+            int k = CGAL::sign(p) * CGAL::sign(q),
+                e = determinant_sign(h.d(), q, plane.d(), p) * CGAL::sign(p);
+            if (k > 0 && e < 0)
+                return ON_NEGATIVE_SIDE;
+            if (k < 0 && e > 0)
+                return ON_POSITIVE_SIDE;
+            return ON_NEGATIVE_SIDE | ON_POSITIVE_SIDE;
+        }
 
-        bool has_children() {
+        bool meets(const Cell<Kernel> &cell) const {
+            auto p = cell.poly.points_begin();
+            for (const FilteredPoint &fp : cell.fvertices) {
+                if (oriented_side(fplane, plane, fp, *p) != CGAL::ON_POSITIVE_SIDE)
+                    return true;
+                ++p;
+            }
             return false;
         }
 };
 
-// CLASS BSPTree
+// CLASS BasicPolyhedron_3
 
-BSPTree::BSPTree() : BSPTree({}) {}
+template <class Kernel>
+std::atomic<int> BasicPolyhedron_3<Kernel>::_max_id(0);
 
-BSPTree::BSPTree(std::initializer_list<Polyhedron_3> il) : BSPTree(std::vector<Polyhedron_3>(il)) {}
+template <class Kernel>
+BasicPolyhedron_3<Kernel>::BasicPolyhedron_3()
+        : _id(_max_id++) {}
 
-BSPTree::BSPTree(const std::vector<Polyhedron_3> &v) : root(::create_node(v)) {}
+template <class Kernel>
+BasicPolyhedron_3<Kernel>::BasicPolyhedron_3(const CGALPolyhedron_3 &poly)
+        : CGALPolyhedron_3(poly), _id(_max_id++) {}
 
-BSPTree::BSPTree(BSPTree &&other) {
-    Node *other_root = other.root;
-    other.root = root;
-    root = other_root;
+template <class Kernel>
+bool BasicPolyhedron_3<Kernel>::operator==(const BasicPolyhedron_3 &other) const {
+    return other._id == _id;
 }
 
-BSPTree& BSPTree::operator=(BSPTree &&other) {
-    Node *other_root = other.root;
-    other.root = root;
-    root = other_root;
-
-    return *this;
+template <class Kernel>
+bool BasicPolyhedron_3<Kernel>::operator<(const BasicPolyhedron_3 &other) const {
+    return _id < other._id;
 }
 
-BSPTree::~BSPTree() {
-    clear();
+template <class Kernel>
+int BasicPolyhedron_3<Kernel>::id() const {
+    return _id;
 }
 
-bool BSPTree::locate(const Point_3 &p, Polyhedron_3 &poly) const {
-    if (empty())
-        return false;
-
-    Node *node = root;
-    while (node->has_children()) {
-        InternalNode *inode = static_cast<InternalNode*>(node);
+// CLASS Cell
+
+template <class Kernel>
+Cell<Kernel>::Cell(Polyhedron_3 &&_poly) : poly(std::move(_poly)) {
+    for (auto it = poly.planes_begin(); it != poly.planes_end(); ++it) {
+        // orient the plane by any vertex off it; planes containing every
+        // vertex constrain nothing
+        auto it_p = poly.points_begin();
+        while (it_p != poly.points_end() && it->oriented_side(*it_p) == CGAL::ON_ORIENTED_BOUNDARY)
+            ++it_p;
+        if (it_p == poly.points_end())
+            continue;
 
-        switch (inode->plane.oriented_side(p)) {
-            case CGAL::ON_POSITIVE_SIDE:
-                node = inode->right;
-                break;
-            case CGAL::ON_NEGATIVE_SIDE:
-                node = inode->left;
-                break;
-            case CGAL::ON_ORIENTED_BOUNDARY:
-                goto point_on_plane;
+        Plane_3 plane = it->oriented_side(*it_p) == CGAL::ON_POSITIVE_SIDE ? it->opposite() : *it;
+        if (std::find(halfspaces.begin(), halfspaces.end(), plane) == halfspaces.end()) {
+            cache_exact(plane);
+            halfspaces.push_back(plane);
+            fhalfspaces.push_back(FilteredPlane(plane));
         }
     }
 
-    point_on_plane:
-    if (node->has_children()) {
-        InternalNode *inode = static_cast<InternalNode*>(node);
-        auto found = std::find_if(inode->polys.begin(), inode->polys.end(), PointInPolyhedron(p));
-
-        if (found == inode->polys.end())
-            return false;
+    std::fill(lo, lo + 3, std::numeric_limits<double>::infinity());
+    std::fill(hi, hi + 3, -std::numeric_limits<double>::infinity());
+    for (auto it = poly.points_begin(); it != poly.points_end(); ++it) {
+        cache_exact(*it);
+        fvertices.push_back(FilteredPoint(*it));
 
-        poly = *found;
-        return true;
+        double c[3] = { fvertices.back().x, fvertices.back().y, fvertices.back().z };
+        for (int i = 0; i < 3; ++i) {
+            lo[i] = std::min(lo[i], c[i]);
+            hi[i] = std::max(hi[i], c[i]);
+        }
     }
 
-    LeafNode *lnode = static_cast<LeafNode*>(node);
-    if (point_in_polyhedron(lnode->poly, p)) {
-        poly = lnode->poly;
-        return true;
+    // divergence theorem over a fan triangulation of every facet
+    volume = 0;
+    for (auto f = poly.facets_begin(); f != poly.facets_end(); ++f) {
+        auto h0 = f->halfedge(), h = h0->next();
+        FilteredPoint a(h0->vertex()->point());
+        for ( ; h->next() != h0; h = h->next()) {
+            FilteredPoint b(h->vertex()->point()), c(h->next()->vertex()->point());
+            volume += a.x * (b.y * c.z - b.z * c.y)
+                    + a.y * (b.z * c.x - b.x * c.z)
+                    + a.z * (b.x * c.y - b.y * c.x);
+        }
     }
-
-    return false;
+    volume = std::fabs(volume) / 6;
 }
 
-bool insert(Node *node, const Polyhedron_3 &poly) {
-    while (node->has_children()) {
-        int side = oriented_side(static_cast<InternalNode*>(node)->plane, poly),
-            l = side & ON_NEGATIVE_SIDE,
-            r = side & ON_POSITIVE_SIDE,
-            z = side & ON_ORIENTED_BOUNDARY;
-        if (l && r)
-            break;
-        if (l) node = static_cast<InternalNode*>(node)->left;
-        else node = static_cast<InternalNode*>(node)->right;
-    }
+template <class Kernel>
+bool Cell<Kernel>::contains(const Point_3 &p, const FilteredPoint &fp) const {
+    NoQueryCounters counters;
+    return cell_contains(*this, p, fp, counters);
+}
 
-    if (node->has_children()) {
-        InternalNode *inode = static_cast<InternalNode*>(node);
-        return insert(inode->left, poly) & insert(inode->right, poly);
+template <class Kernel>
+bool Cell<Kernel>::overlaps(const Cell &other) const {
+    for (int i = 0; i < 3; ++i) {
+        if (hi[i] < other.lo[i] || other.hi[i] < lo[i])
+            return false;
     }
+    return true;
+}
 
-    LeafNode *lnode = static_cast<LeafNode*>(node);
-    if (lnode->parent->left == lnode)
-        lnode->parent->left = split(poly, lnode->poly);
-    else lnode->parent->right = split(poly, lnode->poly);
+// CLASS CellStore
 
-    delete lnode;
+template <class Kernel>
+const typename CellStore<Kernel>::Index CellStore<Kernel>::NONE;
 
-    return true;
+template <class Kernel>
+typename CellStore<Kernel>::Index CellStore<Kernel>::add(const Polyhedron_3 &poly) {
+    return add(Polyhedron_3(poly));
 }
 
-bool BSPTree::insert(const Polyhedron_3 &poly) {
-    if (!poly.is_valid())
-        return false;
+template <class Kernel>
+typename CellStore<Kernel>::Index CellStore<Kernel>::add(Polyhedron_3 &&poly) {
+    Index found = find(poly.id());
+    if (found != NONE)
+        return found;
 
-    if (!root) {
-        root = new LeafNode(poly);
+    Index index;
+    if (free_slots.empty()) {
+        index = cells.size();
+        cells.push_back(Cell<Kernel>(std::move(poly)));
     }
-    else if (!root->has_children()) {
-        Node *tmp = root;
-        root = split(static_cast<LeafNode*>(root)->poly, poly);
-        delete tmp;
+    else {
+        index = free_slots.back();
+        free_slots.pop_back();
+        cells[index] = Cell<Kernel>(std::move(poly));
     }
-    else return ::insert(root, poly);
 
-    return true;
+    indices[cells[index].poly.id()] = index;
+    if (neighbour_lists.size() < cells.size())
+        neighbour_lists.resize(cells.size());
+    return index;
 }
 
-bool remove(Node *node, const Polyhedron_3 &poly, Node *&root) {
-    if (!node)
-        return false;
+template <class Kernel>
+void CellStore<Kernel>::erase(Index index) {
+    for (const Neighbour &n : neighbour_lists[index]) {
+        std::vector<Neighbour> &other = neighbour_lists[n.cell];
+        other.erase(std::remove_if(other.begin(), other.end(), [index](const Neighbour &m) {
+            return m.cell == index;
+        }), other.end());
+    }
+    neighbour_lists[index].clear();
 
-    while (node->has_children()) {
-        InternalNode *inode = static_cast<InternalNode*>(node);
-        int side = oriented_side(inode->plane, poly),
-            l = side & ON_NEGATIVE_SIDE,
-            r = side & ON_POSITIVE_SIDE,
-            z = side & ON_ORIENTED_BOUNDARY;
+    indices.erase(cells[index].poly.id());
+    cells[index].poly.clear();
+    cells[index].halfspaces.clear();
+    cells[index].fhalfspaces.clear();
+    free_slots.push_back(index);
+}
 
-        if (z)
-            inode->polys.erase(poly);
-        if (l && r)
-            return remove(inode->left, poly, root) | remove(inode->right, poly, root);
+// Records a and b as neighbours if they have opposite facet planes.
+template <class Kernel>
+void CellStore<Kernel>::link(Index a, Index b) {
+    const Cell<Kernel> &A = cells[a], &B = cells[b];
+    for (std::size_t i = 0; i < A.halfspaces.size(); ++i) {
+        const FilteredPlane &fa = A.fhalfspaces[i];
+        for (std::size_t j = 0; j < B.halfspaces.size(); ++j) {
+            const FilteredPlane &fb = B.fhalfspaces[j];
+            // the exact test only for normals opposite up to rounding
+            double dot = fa.a * fb.a + fa.b * fb.b + fa.c * fb.c,
+                   norms = std::sqrt((fa.a * fa.a + fa.b * fa.b + fa.c * fa.c) *
+                                     (fb.a * fb.a + fb.b * fb.b + fb.c * fb.c));
+            if (dot > -(1 - 1e-9) * norms)
+                continue;
+
+            if (A.halfspaces[i] == B.halfspaces[j].opposite()) {
+                Neighbour na = { b, i }, nb = { a, j };
+                neighbour_lists[a].push_back(na);
+                neighbour_lists[b].push_back(nb);
+                return;
+            }
+        }
+    }
+}
 
-        if (l) node = inode->left;
-        else node = inode->right;
+template <class Kernel>
+void CellStore<Kernel>::connect(const std::vector<Index> &added, const Node<Kernel> *root) {
+    std::vector<bool> is_added(cells.size());
+    for (Index i : added)
+        is_added[i] = true;
+
+    std::vector<const Node<Kernel>*> nodes;
+    std::vector<Index> candidates;
+    for (Index a : added) {
+        const Cell<Kernel> &cell = cells[a];
+        // the leaves whose boxes meet the box of the cell; cells crossing
+        // planes sit in several of them
+        candidates.clear();
+        nodes.assign(1, root);
+        while (!nodes.empty()) {
+            const Node<Kernel> *node = nodes.back();
+            nodes.pop_back();
+            bool apart = false;
+            for (int i = 0; i < 3; ++i)
+                apart |= node->hi[i] < cell.lo[i] || cell.hi[i] < node->lo[i];
+            if (apart)
+                continue;
+
+            if (node->has_children()) {
+                nodes.push_back(static_cast<const InternalNode<Kernel>*>(node)->left);
+                nodes.push_back(static_cast<const InternalNode<Kernel>*>(node)->right);
+            }
+            else candidates.push_back(static_cast<const LeafNode<Kernel>*>(node)->cell);
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        for (Index b : candidates) {
+            // pairs of new cells are linked once
+            if (b != a && !(is_added[b] && b < a) && cell.overlaps(cells[b]))
+                link(a, b);
+        }
     }
+}
 
-    LeafNode *lnode = static_cast<LeafNode*>(node);
-    if (!(lnode->poly == poly))
-        return false;
+template <class Kernel>
+const std::vector<Neighbour>& CellStore<Kernel>::neighbours(Index index) const {
+    return neighbour_lists[index];
+}
 
-    Node *new_child = lnode->parent->left == lnode ? lnode->parent->right : lnode->parent->right;
-    InternalNode *parent = static_cast<InternalNode*>(lnode->parent->parent);
-    new_child->parent = parent;
+template <class Kernel>
+typename CellStore<Kernel>::Index CellStore<Kernel>::find(int id) const {
+    auto found = indices.find(id);
+    return found == indices.end() ? NONE : found->second;
+}
 
-    if (lnode->parent->parent) {
-        if (parent->left == lnode->parent)
-            parent->left = new_child;
-        else parent->right = new_child;
-    }
-    else root = new_child;
+template <class Kernel>
+const typename CellStore<Kernel>::Polyhedron_3& CellStore<Kernel>::operator[](Index index) const {
+    return cells[index].poly;
+}
 
-    delete lnode->parent;
-    delete lnode;
+template <class Kernel>
+const Cell<Kernel>& CellStore<Kernel>::cell(Index index) const {
+    return cells[index];
+}
 
-    return true;
+template <class Kernel>
+std::size_t CellStore<Kernel>::size() const {
+    return indices.size();
 }
 
-bool BSPTree::remove(const Polyhedron_3 &poly) {
-    if (!root)
-        return false;
+template <class Kernel>
+void CellStore<Kernel>::clear() {
+    cells.clear();
+    free_slots.clear();
+    indices.clear();
+    neighbour_lists.clear();
+}
 
-    if (root->has_children())
-        return ::remove(root, poly, root);
+// CLASS Node
 
-    if (!(poly == static_cast<LeafNode*>(root)->poly))
-        return false;
+// Nodes are only created and destroyed by a NodePool, never through a
+// pointer to Node, so the hierarchy needs no virtual functions.
+template <class Kernel>
+class Node {
+    bool internal;
 
-    delete root;
-    root = NULL;
+    public:
+        InternalNode<Kernel> *parent;
+        // number of leaves in the subtree
+        std::size_t weight;
+        // updates below the node since it was built
+        std::size_t changes;
+        // set by touch() for rebalance() to visit the node
+        bool dirty;
+        // bounding box of the cells in the subtree, as in Cell
+        double lo[3], hi[3];
+
+        bool has_children() const {
+            return internal;
+        }
+    protected:
+        Node(bool _internal) : internal(_internal), parent(NULL), weight(0), changes(0), dirty(false) {}
+};
 
-    return true;
-}
+template <class Kernel>
+class InternalNode : public Node<Kernel> {
+    typedef typename Kernel::Plane_3 Plane_3;
 
-bool BSPTree::empty() const {
-    return !root;
-}
+    public:
+        Node<Kernel> *left, *right;
+        Plane_3 plane;
+        FilteredPlane fplane;
+        // cells touching or crossing the plane
+        std::vector<Index> polys;
+
+        InternalNode() : Node<Kernel>(true), left(NULL), right(NULL) {}
+
+        void init(Node<Kernel> *_left, Node<Kernel> *_right, const Plane_3 &_plane, const std::vector<Index> &_polys) {
+            this->parent = NULL;
+            left = _left;
+            right = _right;
+            plane = _plane;
+            fplane = FilteredPlane(_plane);
+            // keeps the capacity of a reused node
+            polys.assign(_polys.begin(), _polys.end());
+            cache_exact(plane);
+            left->parent = this;
+            right->parent = this;
+            update();
+            this->changes = 0;
+            this->dirty = false;
+        }
 
-void BSPTree::clear() {
-    std::stack<Node*> nodes;
-    if (root)
-        nodes.push(root);
-    while (!nodes.empty()) {
-        Node *node = nodes.top();
-        nodes.pop();
+        // Recomputes the weight and the box from the children.
+        void update() {
+            this->weight = left->weight + right->weight;
+            for (int i = 0; i < 3; ++i) {
+                this->lo[i] = std::min(left->lo[i], right->lo[i]);
+                this->hi[i] = std::max(left->hi[i], right->hi[i]);
+            }
+        }
+};
 
-        if (node->has_children()) {
-            InternalNode *inode = static_cast<InternalNode*>(node);
-            nodes.push(inode->left);
-            nodes.push(inode->right);
+template <class Kernel>
+class LeafNode : public Node<Kernel> {
+    public:
+        Index cell;
+
+        LeafNode() : Node<Kernel>(false), cell(0) {}
+
+        void init(Index _cell, const Cell<Kernel> &c) {
+            this->parent = NULL;
+            this->weight = 1;
+            this->changes = 0;
+            this->dirty = false;
+            std::copy(c.lo, c.lo + 3, this->lo);
+            std::copy(c.hi, c.hi + 3, this->hi);
+            cell = _cell;
         }
+};
 
-        delete node;
+// CLASS NodePool
+
+// Owns the nodes of a tree. Nodes live in deques and are never destroyed
+// before the pool: released nodes go on a free list, and clear() hands all
+// of them out again without touching any, so emptying a tree costs the
+// same whatever its size and the next build allocates nothing.
+template <class Kernel>
+class NodePool {
+    typedef typename Kernel::Plane_3 Plane_3;
+
+    std::deque<InternalNode<Kernel> > internals;
+    std::deque<LeafNode<Kernel> > leaves;
+    // nodes past these have never been handed out since the last clear()
+    std::size_t used_internals, used_leaves;
+    std::vector<InternalNode<Kernel>*> free_internals;
+    std::vector<LeafNode<Kernel>*> free_leaves;
+    // build threads allocate concurrently
+    std::mutex mutex;
+
+    InternalNode<Kernel>* allocate_internal() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!free_internals.empty()) {
+            InternalNode<Kernel> *node = free_internals.back();
+            free_internals.pop_back();
+            return node;
+        }
+        if (used_internals == internals.size())
+            internals.emplace_back();
+        return &internals[used_internals++];
     }
 
-    root = NULL;
-}
+    LeafNode<Kernel>* allocate_leaf() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!free_leaves.empty()) {
+            LeafNode<Kernel> *node = free_leaves.back();
+            free_leaves.pop_back();
+            return node;
+        }
+        if (used_leaves == leaves.size())
+            leaves.emplace_back();
+        return &leaves[used_leaves++];
+    }
 
-std::ostream& operator<<(std::ostream &out, const BSPTree &t) {
-    print(out, t.root, 0);
-}
+    public:
 
-// FUNCTIONS
+        NodePool() : used_internals(0), used_leaves(0) {}
 
-bool point_in_polyhedron(const Polyhedron_3 &poly, const Point_3 &p) {
-    for (auto it_plane = poly.planes_begin(); it_plane != poly.planes_end(); ++it_plane) {
-        CGAL::Oriented_side side = it_plane->oriented_side(p);
-        if (side == CGAL::ON_ORIENTED_BOUNDARY)
-            continue;
+        InternalNode<Kernel>* internal(Node<Kernel> *left, Node<Kernel> *right, const Plane_3 &plane, const std::vector<Index> &polys) {
+            InternalNode<Kernel> *node = allocate_internal();
+            node->init(left, right, plane, polys);
+            return node;
+        }
 
-        for (auto it_p = poly.points_begin(); it_p != poly.points_end(); ++it_p) {
-            CGAL::Oriented_side _side = it_plane->oriented_side(*it_p);
-            if (_side != CGAL::ON_ORIENTED_BOUNDARY && _side != side)
-                return false;
+        LeafNode<Kernel>* leaf(Index cell, const Cell<Kernel> &c) {
+            LeafNode<Kernel> *node = allocate_leaf();
+            node->init(cell, c);
+            return node;
         }
-    }
 
-    return true;
-}
+        void release(Node<Kernel> *node) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (node->has_children())
+                free_internals.push_back(static_cast<InternalNode<Kernel>*>(node));
+            else free_leaves.push_back(static_cast<LeafNode<Kernel>*>(node));
+        }
 
-int oriented_side(const Plane_3 &plane, const Polyhedron_3 &poly) {
-    int res = 0, max = ON_NEGATIVE_SIDE + ON_ORIENTED_BOUNDARY + ON_POSITIVE_SIDE;
-    for (auto it = poly.points_begin(); it != poly.points_end() && res < max; ++it) {
-        switch (plane.oriented_side(*it)) {
-            case CGAL::ON_NEGATIVE_SIDE:
-                res |= ON_NEGATIVE_SIDE;
-                break;
-            case CGAL::ON_ORIENTED_BOUNDARY:
-                res |= ON_ORIENTED_BOUNDARY;
-                break;
-            case CGAL::ON_POSITIVE_SIDE:
-                res |= ON_POSITIVE_SIDE;
+        // Releases the node and everything below it.
+        void release_tree(Node<Kernel> *root) {
+            std::stack<Node<Kernel>*> nodes;
+            if (root)
+                nodes.push(root);
+            while (!nodes.empty()) {
+                Node<Kernel> *node = nodes.top();
+                nodes.pop();
+
+                if (node->has_children()) {
+                    InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+                    nodes.push(inode->left);
+                    nodes.push(inode->right);
+                }
+
+                release(node);
+            }
         }
-    }
 
-    return res;
+        void clear() {
+            used_internals = used_leaves = 0;
+            free_internals.clear();
+            free_leaves.clear();
+        }
+};
+
+// CLASS BasicBSPTree
+
+template <class Kernel>
+BasicBSPTree<Kernel>::BasicBSPTree(const BuildOptions &_options)
+        : options(_options), pool(new NodePool<Kernel>), root(NULL) {}
+
+template <class Kernel>
+BasicBSPTree<Kernel>::BasicBSPTree(std::initializer_list<Polyhedron_3> il, const BuildOptions &_options)
+        : BasicBSPTree(std::vector<Polyhedron_3>(il), _options) {}
+
+template <class Kernel>
+BasicBSPTree<Kernel>::BasicBSPTree(const std::vector<Polyhedron_3> &v, const BuildOptions &_options)
+        : pool(new NodePool<Kernel>), root(NULL) {
+    rebuild(v, _options);
 }
 
-Node* split(const Polyhedron_3 &poly1, const Polyhedron_3 &poly2) {
-    std::set<Polyhedron_3> polys = { poly1 };
-    for (auto it = poly1.planes_begin(); it != poly1.planes_end(); ++it) {
-        int side1 = oriented_side(*it, poly1),
-            side2 = oriented_side(*it, poly2);
-        if (side1 == side2 || side1 - ON_ORIENTED_BOUNDARY == side2 || side1 == side2 - ON_ORIENTED_BOUNDARY)
-            continue;
+template <class Kernel>
+BasicBSPTree<Kernel>::BasicBSPTree(std::vector<Polyhedron_3> &&v, const BuildOptions &_options)
+        : pool(new NodePool<Kernel>), root(NULL) {
+    rebuild(std::move(v), _options);
+}
 
-        switch (side2) {
-            case ON_NEGATIVE_SIDE + ON_ORIENTED_BOUNDARY:
-                polys.insert(poly2);
-            case ON_NEGATIVE_SIDE:
-                return new InternalNode(new LeafNode(poly2), new LeafNode(poly1), *it, polys);
-            case ON_POSITIVE_SIDE + ON_ORIENTED_BOUNDARY:
-                polys.insert(poly2);
-            case ON_POSITIVE_SIDE:
-                return new InternalNode(new LeafNode(poly1), new LeafNode(poly2), *it, polys);
-        }
-    }
+template <class Kernel>
+BasicBSPTree<Kernel>::BasicBSPTree(BasicBSPTree &&other)
+        : store(std::move(other.store)), options(other.options), pool(std::move(other.pool)), root(other.root) {
+    other.root = NULL;
+    other.store.clear();
+}
 
-    polys = { poly2 };
-    for (auto it = poly2.planes_begin(); it != poly2.planes_end(); ++it) {
-        int side1 = oriented_side(*it, poly1),
-            side2 = oriented_side(*it, poly2);
-        if (side2 == side1 || side2 - ON_ORIENTED_BOUNDARY == side1 || side2 == side1 - ON_ORIENTED_BOUNDARY)
-            continue;
+template <class Kernel>
+BasicBSPTree<Kernel>& BasicBSPTree<Kernel>::operator=(BasicBSPTree &&other) {
+    std::swap(store, other.store);
+    std::swap(options, other.options);
+    std::swap(pool, other.pool);
+    std::swap(root, other.root);
 
-        switch (side1) {
-            case ON_NEGATIVE_SIDE + ON_ORIENTED_BOUNDARY:
-                polys.insert(poly1);
-            case ON_NEGATIVE_SIDE:
-                return new InternalNode(new LeafNode(poly1), new LeafNode(poly2), *it, polys);
-            case ON_POSITIVE_SIDE + ON_ORIENTED_BOUNDARY:
-                polys.insert(poly1);
-            case ON_POSITIVE_SIDE:
-                return new InternalNode(new LeafNode(poly2), new LeafNode(poly1), *it, polys);
-        }
+    return *this;
+}
+
+template <class Kernel>
+BasicBSPTree<Kernel>::~BasicBSPTree() {}
+
+template <class Kernel>
+void BasicBSPTree<Kernel>::rebuild(const std::vector<Polyhedron_3> &v, const BuildOptions &_options) {
+    clear();
+    if (!pool)
+        pool.reset(new NodePool<Kernel>);
+    options = _options;
+
+    std::vector<Index> cells;
+    for (const Polyhedron_3 &poly : v) {
+        if (store.find(poly.id()) == Cells::NONE)
+            cells.push_back(store.add(poly));
     }
 
-    //return new LeafNode(poly1);
-    throw std::runtime_error("Intersecting polyhedrons!");
+    try {
+        root = ::create_node(store, *pool, cells, options, options.seed, options.threads ? options.threads : default_threads());
+    } catch (...) {
+        clear();
+        throw;
+    }
+    store.connect(cells, root);
 }
 
-Node* create_node(const std::vector<Polyhedron_3> &v) {
-    int size = v.size();
-    switch (size) {
-        case 0:
-            return NULL;
-        case 1:
-            return new LeafNode(v[0]);
-        case 2:
-            return split(v[0], v[1]);
-    }
-
-    std::vector<Polyhedron_3> left, right;
-    std::vector<Polyhedron_3> polys;
-    Plane_3 plane;
-    for (const Polyhedron_3 &poly: v) {
-        //const Polyhedron_3 &poly = v[rand() % v.size()];
-        for (auto plane_it = poly.planes_begin(); plane_it != poly.planes_end(); ++plane_it) {
-            int side = oriented_side(*plane_it, poly);
-
-            left.clear();
-            right.clear();
-            polys.clear();
-
-            for (const Polyhedron_3 &poly: v) {
-                int side = oriented_side(*plane_it, poly);
-                if (side & ON_NEGATIVE_SIDE)
-                    left.push_back(poly);
-                if (side & ON_POSITIVE_SIDE)
-                    right.push_back(poly);
-                if (side & ON_ORIENTED_BOUNDARY)
-                    polys.push_back(poly);
-            }
+template <class Kernel>
+void BasicBSPTree<Kernel>::rebuild(std::vector<Polyhedron_3> &&v, const BuildOptions &_options) {
+    clear();
+    if (!pool)
+        pool.reset(new NodePool<Kernel>);
+    options = _options;
+
+    std::vector<Index> cells;
+    for (Polyhedron_3 &poly : v) {
+        if (store.find(poly.id()) == Cells::NONE)
+            cells.push_back(store.add(std::move(poly)));
+    }
 
-            if (left.size() && left.size() < size && right.size() && right.size() < size) {
-                plane = *plane_it;
-                goto found_divider;
-            }
-        }
+    try {
+        root = ::create_node(store, *pool, cells, options, options.seed, options.threads ? options.threads : default_threads());
+    } catch (...) {
+        clear();
+        throw;
     }
+    store.connect(cells, root);
+}
 
-found_divider:
-    Node *node_left = create_node(left);
-    left.clear();
-    Node *node_right = create_node(right);
-    right.clear();
-    return new InternalNode(node_left, node_right, plane, std::set<Polyhedron_3>(polys.begin(), polys.end()));
+template <class Kernel>
+const typename BasicBSPTree<Kernel>::Polyhedron_3* BasicBSPTree<Kernel>::locate(const Point_3 &p) const {
+    if (empty())
+        return NULL;
+
+    NoQueryCounters counters;
+    return locate_point(store, root, p, counters);
 }
 
-std::ostream& print(std::ostream &out, Node *node, int depth) {
+template <class Kernel>
+const typename BasicBSPTree<Kernel>::Polyhedron_3* BasicBSPTree<Kernel>::locate(const Point_3 &p, QueryStats &stats) const {
+    ++stats.queries;
+    if (empty())
+        return NULL;
+
+    QueryCounters counters(stats);
+    return locate_point(store, root, p, counters);
+}
+
+template <class Kernel, class Counters>
+const BasicPolyhedron_3<Kernel>* locate_point(const CellStore<Kernel> &store, Node<Kernel> *node,
+        const typename Kernel::Point_3 &p, Counters &counters) {
+    FilteredPoint fp(p);
+    while (node->has_children()) {
+        InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+
+        counters.plane();
+        switch (oriented_side(inode->fplane, inode->plane, fp, p, counters)) {
+            case CGAL::ON_POSITIVE_SIDE:
+                node = inode->right;
+                break;
+            case CGAL::ON_NEGATIVE_SIDE:
+                node = inode->left;
+                break;
+            case CGAL::ON_ORIENTED_BOUNDARY:
+                goto point_on_plane;
+        }
+    }
+
+    point_on_plane:
+    if (node->has_children()) {
+        InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+        for (Index cell : inode->polys) {
+            if (cell_contains(store.cell(cell), p, fp, counters))
+                return &store[cell];
+        }
+
+        return NULL;
+    }
+
+    LeafNode<Kernel> *lnode = static_cast<LeafNode<Kernel>*>(node);
+    if (cell_contains(store.cell(lnode->cell), p, fp, counters))
+        return &store[lnode->cell];
+
+    return NULL;
+}
+
+template <class Kernel>
+const typename BasicBSPTree<Kernel>::Polyhedron_3* BasicBSPTree<Kernel>::locate(const Point_3 &p,
+        const Polyhedron_3 *hint) const {
+    if (empty())
+        return NULL;
+
+    NoQueryCounters counters;
+    return locate_hinted(store, root, p, hint, counters);
+}
+
+template <class Kernel>
+const typename BasicBSPTree<Kernel>::Polyhedron_3* BasicBSPTree<Kernel>::locate(const Point_3 &p,
+        const Polyhedron_3 *hint, QueryStats &stats) const {
+    ++stats.queries;
+    if (empty())
+        return NULL;
+
+    QueryCounters counters(stats);
+    return locate_hinted(store, root, p, hint, counters);
+}
+
+// Largest distance of the point beyond a facet plane of the cell, in
+// floating point, and the half-space of that plane.
+template <class Kernel>
+double outside_distance(const Cell<Kernel> &cell, const FilteredPoint &fp, std::size_t &halfspace) {
+    double furthest = -std::numeric_limits<double>::infinity();
+    halfspace = 0;
+    for (std::size_t i = 0; i < cell.fhalfspaces.size(); ++i) {
+        const FilteredPlane &h = cell.fhalfspaces[i];
+        double distance = (h.a * fp.x + h.b * fp.y + h.c * fp.z + h.d) /
+                std::sqrt(h.a * h.a + h.b * h.b + h.c * h.c);
+        if (distance > furthest) {
+            furthest = distance;
+            halfspace = i;
+        }
+    }
+    return furthest;
+}
+
+// Walks from the hint towards the point, leaving every cell through the
+// facet the point lies furthest beyond, and descends from the root if the
+// walk leaves the cells or takes too long.
+template <class Kernel, class Counters>
+const BasicPolyhedron_3<Kernel>* locate_hinted(const CellStore<Kernel> &store, Node<Kernel> *root,
+        const typename Kernel::Point_3 &p, const BasicPolyhedron_3<Kernel> *hint, Counters &counters) {
+    FilteredPoint fp(p);
+    Index cell = CellStore<Kernel>::NONE, previous = CellStore<Kernel>::NONE;
+    if (hint) {
+        counters.hint();
+        cell = store.find(hint->id());
+    }
+
+    for (std::size_t step = 0; cell != CellStore<Kernel>::NONE && step <= HINT_WALK_STEPS; ++step) {
+        const Cell<Kernel> &c = store.cell(cell);
+        if (cell_contains(c, p, fp, counters)) {
+            if (step)
+                counters.walk_hit();
+            else counters.hint_hit();
+            return &store[cell];
+        }
+
+        // among the cells beyond that facet, which include cells meeting
+        // this one only along an edge, the one the point is closest to
+        std::size_t exit;
+        outside_distance(c, fp, exit);
+        Index next = CellStore<Kernel>::NONE;
+        double closest = std::numeric_limits<double>::infinity();
+        for (const Neighbour &n : store.neighbours(cell)) {
+            if (n.halfspace != exit || n.cell == previous)
+                continue;
+            std::size_t unused;
+            double distance = outside_distance(store.cell(n.cell), fp, unused);
+            if (distance < closest) {
+                closest = distance;
+                next = n.cell;
+            }
+        }
+        previous = cell;
+        cell = next;
+    }
+
+    return locate_point(store, root, p, counters);
+}
+
+template <class Kernel>
+void BasicBSPTree<Kernel>::range_ids(const Iso_cuboid_3 &box, const std::function<void(int)> &out) const {
+    if (!root)
+        return;
+
+    std::unordered_set<Index> seen;
+    range_node(store, root, BoxRegion<Kernel>(box), seen, out);
+}
+
+template <class Kernel>
+void BasicBSPTree<Kernel>::range_ids(const Plane_3 &plane, const std::function<void(int)> &out) const {
+    if (!root)
+        return;
+
+    std::unordered_set<Index> seen;
+    range_node(store, root, HalfspaceRegion<Kernel>(plane), seen, out);
+}
+
+// Reports the cells of the subtree meeting the region, skipping children
+// on the other side of a plane than the whole region. Cells crossing
+// planes sit in several leaves and are tested once.
+template <class Kernel, class Region>
+void range_node(const CellStore<Kernel> &store, Node<Kernel> *node, const Region &region,
+        std::unordered_set<Index> &seen, const std::function<void(int)> &out) {
+    while (node->has_children()) {
+        InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+        int side = region.side(*inode);
+        if (side == ON_NEGATIVE_SIDE)
+            node = inode->left;
+        else if (side == ON_POSITIVE_SIDE)
+            node = inode->right;
+        else {
+            range_node(store, inode->left, region, seen, out);
+            node = inode->right;
+        }
+    }
+
+    Index cell = static_cast<LeafNode<Kernel>*>(node)->cell;
+    if (seen.insert(cell).second && region.meets(store.cell(cell)))
+        out(store[cell].id());
+}
+
+// Distance from the point to the box, 0 inside.
+double box_distance(const double *lo, const double *hi, const FilteredPoint &fp) {
+    double c[3] = { fp.x, fp.y, fp.z }, sum = 0;
+    for (int i = 0; i < 3; ++i) {
+        double d = std::max(std::max(lo[i] - c[i], c[i] - hi[i]), 0.0);
+        sum += d * d;
+    }
+    return std::sqrt(sum);
+}
+
+// Distance from p to the triangle abc, through the Voronoi regions of its
+// vertices, edges and interior.
+double triangle_distance(const FilteredPoint &p, const FilteredPoint &a,
+        const FilteredPoint &b, const FilteredPoint &c) {
+    double ab[3] = { b.x - a.x, b.y - a.y, b.z - a.z },
+           ac[3] = { c.x - a.x, c.y - a.y, c.z - a.z },
+           ap[3] = { p.x - a.x, p.y - a.y, p.z - a.z },
+           bp[3] = { p.x - b.x, p.y - b.y, p.z - b.z },
+           cp[3] = { p.x - c.x, p.y - c.y, p.z - c.z };
+    auto dot = [](const double *u, const double *v) {
+        return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+    };
+
+    // the nearest point is a + v * ab + w * ac
+    double v, w;
+    double d1 = dot(ab, ap), d2 = dot(ac, ap),
+           d3 = dot(ab, bp), d4 = dot(ac, bp),
+           d5 = dot(ab, cp), d6 = dot(ac, cp),
+           va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6, vc = d1 * d4 - d3 * d2;
+    if (d1 <= 0 && d2 <= 0)
+        v = w = 0;
+    else if (d3 >= 0 && d4 <= d3)
+        v = 1, w = 0;
+    else if (vc <= 0 && d1 >= 0 && d3 <= 0)
+        v = d1 / (d1 - d3), w = 0;
+    else if (d6 >= 0 && d5 <= d6)
+        v = 0, w = 1;
+    else if (vb <= 0 && d2 >= 0 && d6 <= 0)
+        v = 0, w = d2 / (d2 - d6);
+    else if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0)
+        w = (d4 - d3) / ((d4 - d3) + (d5 - d6)), v = 1 - w;
+    else {
+        double sum = va + vb + vc;
+        v = vb / sum;
+        w = vc / sum;
+    }
+
+    double d[3];
+    for (int i = 0; i < 3; ++i)
+        d[i] = ap[i] - v * ab[i] - w * ac[i];
+    return std::sqrt(dot(d, d));
+}
+
+// Distance from the point to the cell in floating point, 0 if the cell
+// contains it: outside a convex cell the nearest point lies on a facet.
+template <class Kernel>
+double cell_distance(const Cell<Kernel> &cell, const typename Kernel::Point_3 &p, const FilteredPoint &fp) {
+    if (box_distance(cell.lo, cell.hi, fp) == 0 && cell.contains(p, fp))
+        return 0;
+
+    double nearest = std::numeric_limits<double>::infinity();
+    for (auto f = cell.poly.facets_begin(); f != cell.poly.facets_end(); ++f) {
+        auto h0 = f->halfedge(), h = h0->next();
+        FilteredPoint a(h0->vertex()->point());
+        for ( ; h->next() != h0; h = h->next()) {
+            FilteredPoint b(h->vertex()->point()), c(h->next()->vertex()->point());
+            // NaN from a degenerate triangle compares false
+            double distance = triangle_distance(fp, a, b, c);
+            if (distance < nearest)
+                nearest = distance;
+        }
+    }
+    return nearest;
+}
+
+template <class Kernel>
+bool BasicBSPTree<Kernel>::nearest(const Point_3 &p, Near &near, double max_distance) const {
+    std::vector<Near> res = nearest(p, 1, max_distance);
+    if (res.empty())
+        return false;
+
+    near = res[0];
+    return true;
+}
+
+// Best first: subtrees wait in a queue keyed by a lower bound on the
+// distance of their cells, the distance to their box or, behind a
+// splitting plane, to the plane. Cells crossing the plane sit on the near
+// side too, so the bound holds for every cell not found there.
+template <class Kernel>
+std::vector<typename BasicBSPTree<Kernel>::Near> BasicBSPTree<Kernel>::nearest(const Point_3 &p, std::size_t k,
+        double max_distance) const {
+    typedef std::pair<double, Node<Kernel>*> Entry;
+
+    std::vector<Near> res;
+    if (!root || !k)
+        return res;
+
+    FilteredPoint fp(p);
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > queue;
+    // the nearest cells so far, the furthest of them on top
+    std::vector<std::pair<double, Index> > best;
+    std::unordered_set<Index> seen;
+    auto bound = [&]() {
+        return best.size() < k ? max_distance : best.front().first;
+    };
+
+    queue.push(Entry(box_distance(root->lo, root->hi, fp), root));
+    while (!queue.empty() && queue.top().first <= bound()) {
+        Node<Kernel> *node = queue.top().second;
+        queue.pop();
+
+        if (node->has_children()) {
+            InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+            const FilteredPlane &h = inode->fplane;
+            double offset = (h.a * fp.x + h.b * fp.y + h.c * fp.z + h.d) /
+                    std::sqrt(h.a * h.a + h.b * h.b + h.c * h.c);
+            double left = box_distance(inode->left->lo, inode->left->hi, fp),
+                   right = box_distance(inode->right->lo, inode->right->hi, fp);
+            if (offset > 0)
+                left = std::max(left, offset);
+            else right = std::max(right, -offset);
+
+            if (left <= bound())
+                queue.push(Entry(left, inode->left));
+            if (right <= bound())
+                queue.push(Entry(right, inode->right));
+            continue;
+        }
+
+        Index cell = static_cast<LeafNode<Kernel>*>(node)->cell;
+        if (!seen.insert(cell).second)
+            continue;
+
+        double distance = cell_distance(store.cell(cell), p, fp);
+        if (best.size() < k ? distance > max_distance : distance >= best.front().first)
+            continue;
+
+        if (best.size() == k) {
+            std::pop_heap(best.begin(), best.end());
+            best.pop_back();
+        }
+        best.push_back(std::make_pair(distance, cell));
+        std::push_heap(best.begin(), best.end());
+    }
+
+    std::sort_heap(best.begin(), best.end());
+    for (const auto &b : best)
+        res.push_back(Near{ &store[b.second], b.first });
+    return res;
+}
+
+template <class Kernel>
+std::vector<typename BasicBSPTree<Kernel>::Hit> BasicBSPTree<Kernel>::trace(const Ray_3 &ray) const {
+    return trace_line(store, root, LinePart<Kernel>(ray));
+}
+
+template <class Kernel>
+std::vector<typename BasicBSPTree<Kernel>::Hit> BasicBSPTree<Kernel>::trace(const Segment_3 &segment) const {
+    return trace_line(store, root, LinePart<Kernel>(segment));
+}
+
+template <class Kernel>
+bool BasicBSPTree<Kernel>::first_hit(const Ray_3 &ray, Hit &hit) const {
+    return first_hit_line(store, root, LinePart<Kernel>(ray), hit);
+}
+
+template <class Kernel>
+bool BasicBSPTree<Kernel>::first_hit(const Segment_3 &segment, Hit &hit) const {
+    return first_hit_line(store, root, LinePart<Kernel>(segment), hit);
+}
+
+template <class Kernel>
+void BasicBSPTree<Kernel>::first_hit_batch(const Ray_3 *rays, std::size_t n, int *ids) const {
+    first_hit_batch(rays, n, ids, 1);
+}
+
+template <class Kernel>
+void BasicBSPTree<Kernel>::first_hit_batch(const Ray_3 *rays, std::size_t n, int *ids, unsigned threads) const {
+    parallel_for(n, PACKET_SIZE, threads, [&](std::size_t begin, std::size_t end) {
+        Hit hit;
+        for (std::size_t i = begin; i < end; ++i)
+            ids[i] = first_hit(rays[i], hit) ? hit.poly->id() : -1;
+    });
+}
+
+template <class Kernel>
+void BasicBSPTree<Kernel>::first_hit_batch(const Segment_3 *segments, std::size_t n, int *ids) const {
+    first_hit_batch(segments, n, ids, 1);
+}
+
+template <class Kernel>
+void BasicBSPTree<Kernel>::first_hit_batch(const Segment_3 *segments, std::size_t n, int *ids,
+        unsigned threads) const {
+    parallel_for(n, PACKET_SIZE, threads, [&](std::size_t begin, std::size_t end) {
+        Hit hit;
+        for (std::size_t i = begin; i < end; ++i)
+            ids[i] = first_hit(segments[i], hit) ? hit.poly->id() : -1;
+    });
+}
+
+// Sets a + b * t to the value of the plane equation at source + t * v.
+template <class Kernel>
+void plane_along(const typename Kernel::Plane_3 &h, const LinePart<Kernel> &line, typename Kernel::FT &a,
+        typename Kernel::FT &b) {
+    a = h.a() * line.source.x() + h.b() * line.source.y() + h.c() * line.source.z() + h.d();
+    b = h.a() * line.v.x() + h.b() * line.v.y() + h.c() * line.v.z();
+}
+
+// Clips the parameter interval [t0, t1], or [t0, inf) if not bounded, to
+// the points of the line inside the cell. Returns false if none are left.
+template <class Kernel>
+bool clip(const Cell<Kernel> &cell, const LinePart<Kernel> &line, typename Kernel::FT &t0,
+        typename Kernel::FT &t1, bool &bounded) {
+    typedef typename Kernel::FT FT;
+
+    for (const typename Kernel::Plane_3 &h : cell.halfspaces) {
+        FT a, b;
+        plane_along(h, line, a, b);
+        // the inside is a + b * t <= 0
+        if (b == 0) {
+            if (a > 0)
+                return false;
+            continue;
+        }
+
+        FT t = -a / b;
+        if (b > 0) {
+            if (!bounded || t < t1) {
+                t1 = t;
+                bounded = true;
+            }
+        }
+        else if (t > t0)
+            t0 = t;
+
+        if (bounded && t1 < t0)
+            return false;
+    }
+    return true;
+}
+
+// Calls visit(leaf, t0, t1, bounded) for the leaves whose regions the part
+// [t0, t1] of the line crosses, front to back, until it returns true.
+// Returns whether it did. A line running in a splitting plane meets the
+// cells on both sides along the same stretch, so there both subtrees are
+// visited, one after the other, each until visit returns true.
+template <class Kernel, class Visit>
+bool trace_node(Node<Kernel> *node, const LinePart<Kernel> &line, const typename Kernel::FT &t0,
+        const typename Kernel::FT &t1, bool bounded, Visit &visit) {
+    typedef typename Kernel::FT FT;
+
+    while (node->has_children()) {
+        InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+        FT a, b;
+        plane_along(inode->plane, line, a, b);
+
+        if (b == 0) {
+            if (a < 0)
+                node = inode->left;
+            else if (a > 0)
+                node = inode->right;
+            else {
+                bool left = trace_node(inode->left, line, t0, t1, bounded, visit),
+                     right = trace_node(inode->right, line, t0, t1, bounded, visit);
+                return left || right;
+            }
+            continue;
+        }
+
+        // the line crosses the plane at t, from the negative side if b > 0
+        FT t = -a / b;
+        Node<Kernel> *near = b > 0 ? inode->left : inode->right,
+                     *far = b > 0 ? inode->right : inode->left;
+        // a crossing at either end still touches the cells on the other side
+        if (t < t0)
+            node = far;
+        else if (bounded && t > t1)
+            node = near;
+        else return trace_node(near, line, t0, t, true, visit) ||
+                    trace_node(far, line, t, t1, bounded, visit);
+    }
+
+    return visit(static_cast<LeafNode<Kernel>*>(node), t0, t1, bounded);
+}
+
+// Whether the line meets the cell within [t0, t1]. The hit spans the whole
+// part of the line inside the cell, which may reach into other leaves.
+template <class Kernel>
+bool meets(const CellStore<Kernel> &store, Index cell, const LinePart<Kernel> &line,
+        const typename Kernel::FT &t0, const typename Kernel::FT &t1, bool bounded,
+        typename BasicBSPTree<Kernel>::Hit &hit) {
+    typedef typename Kernel::FT FT;
+
+    FT enter = 0, exit = 1;
+    bool exit_bounded = line.bounded;
+    if (!clip(store.cell(cell), line, enter, exit, exit_bounded))
+        return false;
+    // a ray of direction 0 stays at its source
+    if (!exit_bounded)
+        exit = enter;
+    if ((bounded && enter > t1) || exit < t0)
+        return false;
+
+    hit.poly = &store[cell];
+    hit.enter = enter;
+    hit.exit = exit;
+    return true;
+}
+
+template <class Kernel>
+std::vector<typename BasicBSPTree<Kernel>::Hit> trace_line(const CellStore<Kernel> &store, Node<Kernel> *root,
+        const LinePart<Kernel> &line) {
+    typedef typename Kernel::FT FT;
+    typedef typename BasicBSPTree<Kernel>::Hit Hit;
+
+    std::vector<Hit> hits;
+    if (!root)
+        return hits;
+
+    // cells crossing planes sit in several leaves
+    std::unordered_set<Index> seen;
+    auto visit = [&](LeafNode<Kernel> *leaf, const FT &t0, const FT &t1, bool bounded) {
+        Hit hit;
+        if (!seen.count(leaf->cell) && meets(store, leaf->cell, line, t0, t1, bounded, hit)) {
+            seen.insert(leaf->cell);
+            hits.push_back(hit);
+        }
+        return false;
+    };
+    trace_node(root, line, FT(0), FT(1), line.bounded, visit);
+    // only out of order where the line runs in a splitting plane
+    std::stable_sort(hits.begin(), hits.end(), [](const Hit &a, const Hit &b) {
+        return a.enter < b.enter;
+    });
+    return hits;
+}
+
+template <class Kernel>
+bool first_hit_line(const CellStore<Kernel> &store, Node<Kernel> *root, const LinePart<Kernel> &line,
+        typename BasicBSPTree<Kernel>::Hit &hit) {
+    typedef typename Kernel::FT FT;
+    typedef typename BasicBSPTree<Kernel>::Hit Hit;
+
+    if (!root)
+        return false;
+
+    bool found = false;
+    auto visit = [&](LeafNode<Kernel> *leaf, const FT &t0, const FT &t1, bool bounded) {
+        Hit candidate;
+        if (!meets(store, leaf->cell, line, t0, t1, bounded, candidate))
+            return false;
+        if (!found || candidate.enter < hit.enter)
+            hit = candidate;
+        found = true;
+        return true;
+    };
+    return trace_node(root, line, FT(0), FT(1), line.bounded, visit);
+}
+
+template <class Kernel>
+bool BasicBSPTree<Kernel>::locate(const Point_3 &p, Polyhedron_3 &poly) const {
+    const Polyhedron_3 *found = locate(p);
+    if (!found)
+        return false;
+
+    poly = *found;
+    return true;
+}
+
+template <class Kernel>
+void BasicBSPTree<Kernel>::locate_batch(const Point_3 *points, std::size_t n, int *ids) const {
+    if (empty()) {
+        std::fill(ids, ids + n, -1);
+        return;
+    }
+
+    Packet packet(std::min(n, PACKET_SIZE));
+    for (std::size_t start = 0; start < n; start += PACKET_SIZE) {
+        std::size_t size = std::min(PACKET_SIZE, n - start);
+        for (std::size_t i = 0; i < size; ++i) {
+            const Point_3 &p = points[start + i];
+            packet.x[i] = CGAL::to_double(p.x());
+            packet.y[i] = CGAL::to_double(p.y());
+            packet.z[i] = CGAL::to_double(p.z());
+            packet.index[i] = i;
+        }
+
+        locate_packet(store, root, packet, 0, size, points + start, ids + start);
+    }
+}
+
+template <class Kernel>
+void BasicBSPTree<Kernel>::locate_batch(const Point_3 *points, std::size_t n, int *ids, unsigned threads) const {
+    // whole packets per chunk, enough of them to amortise claiming a chunk
+    parallel_for(n, 16 * PACKET_SIZE, threads, [&](std::size_t begin, std::size_t end) {
+        locate_batch(points + begin, end - begin, ids + begin);
+    });
+}
+
+// Whether insert() can add the cell to the subtree: split() finds a plane
+// between it and the cell of every leaf it reaches. Changes nothing.
+template <class Kernel>
+bool fits(const CellStore<Kernel> &store, Node<Kernel> *node, Index cell) {
+    const Cell<Kernel> &c = store.cell(cell);
+    while (node->has_children()) {
+        InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+        int side = oriented_side(inode->plane, inode->fplane, c),
+            l = side & ON_NEGATIVE_SIDE,
+            r = side & ON_POSITIVE_SIDE;
+
+        if (l && r)
+            return fits(store, inode->left, cell) && fits(store, inode->right, cell);
+        if (l) node = inode->left;
+        else node = inode->right;
+    }
+
+    const Cell<Kernel> &other = store.cell(static_cast<LeafNode<Kernel>*>(node)->cell);
+    std::size_t i;
+    return separating_halfspace(c, other, i) || separating_halfspace(other, c, i);
+}
+
+template <class Kernel>
+bool insert(const CellStore<Kernel> &store, NodePool<Kernel> &pool, Node<Kernel> *node, Index cell) {
+    while (node->has_children()) {
+        InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+        int side = oriented_side(inode->plane, inode->fplane, store.cell(cell)),
+            l = side & ON_NEGATIVE_SIDE,
+            r = side & ON_POSITIVE_SIDE;
+
+        if (on_boundary(side))
+            inode->polys.push_back(cell);
+        if (l && r)
+            break;
+        if (l) node = inode->left;
+        else node = inode->right;
+    }
+
+    if (node->has_children()) {
+        InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+        Node<Kernel> *left = inode->left, *right = inode->right;
+        return insert(store, pool, left, cell) & insert(store, pool, right, cell);
+    }
+
+    LeafNode<Kernel> *lnode = static_cast<LeafNode<Kernel>*>(node);
+    Node<Kernel> *new_node = split(store, pool, cell, lnode->cell);
+    new_node->parent = lnode->parent;
+    if (lnode->parent->left == lnode)
+        lnode->parent->left = new_node;
+    else lnode->parent->right = new_node;
+
+    pool.release(lnode);
+    touch(new_node->parent);
+
+    return true;
+}
+
+template <class Kernel>
+bool BasicBSPTree<Kernel>::insert(const Polyhedron_3 &poly) {
+    if (!poly.is_valid() || store.find(poly.id()) != Cells::NONE)
+        return false;
+
+    return insert(Polyhedron_3(poly));
+}
+
+template <class Kernel>
+bool BasicBSPTree<Kernel>::insert(Polyhedron_3 &&poly) {
+    if (!poly.is_valid() || store.find(poly.id()) != Cells::NONE)
+        return false;
+
+    if (!pool)
+        pool.reset(new NodePool<Kernel>);
+
+    Index cell = store.add(std::move(poly));
+    // ::insert() changes nodes on the way down, so check first
+    if (root && !fits(store, root, cell)) {
+        store.erase(cell);
+        throw std::runtime_error("Intersecting polyhedrons!");
+    }
+
+    if (!root) {
+        root = pool->leaf(cell, store.cell(cell));
+    }
+    else if (!root->has_children()) {
+        Node<Kernel> *tmp = root;
+        root = split(store, *pool, static_cast<LeafNode<Kernel>*>(root)->cell, cell);
+        pool->release(tmp);
+    }
+    else {
+        ::insert(store, *pool, root, cell);
+        root = ::rebalance(store, *pool, root, options, options.threads ? options.threads : default_threads());
+    }
+    store.connect(std::vector<Index>(1, cell), root);
+
+    return true;
+}
+
+template <class Kernel>
+bool remove(const CellStore<Kernel> &store, NodePool<Kernel> &pool, Node<Kernel> *node, Index cell, Node<Kernel> *&root) {
+    if (!node)
+        return false;
+
+    while (node->has_children()) {
+        InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+        int side = oriented_side(inode->plane, inode->fplane, store.cell(cell)),
+            l = side & ON_NEGATIVE_SIDE,
+            r = side & ON_POSITIVE_SIDE;
+
+        if (on_boundary(side))
+            inode->polys.erase(std::remove(inode->polys.begin(), inode->polys.end(), cell), inode->polys.end());
+        if (l && r) {
+            // removing from the left subtree may release inode
+            Node<Kernel> *left = inode->left, *right = inode->right;
+            return remove(store, pool, left, cell, root) | remove(store, pool, right, cell, root);
+        }
+
+        if (l) node = inode->left;
+        else node = inode->right;
+    }
+
+    LeafNode<Kernel> *lnode = static_cast<LeafNode<Kernel>*>(node);
+    if (lnode->cell != cell)
+        return false;
+
+    if (!lnode->parent) {
+        // the other leaf of the cell has already replaced the root
+        pool.release(lnode);
+        root = NULL;
+        return true;
+    }
+
+    Node<Kernel> *new_child = lnode->parent->left == lnode ? lnode->parent->right : lnode->parent->left;
+    InternalNode<Kernel> *parent = lnode->parent->parent;
+    new_child->parent = parent;
+
+    if (parent) {
+        if (parent->left == lnode->parent)
+            parent->left = new_child;
+        else parent->right = new_child;
+    }
+    else root = new_child;
+
+    pool.release(lnode->parent);
+    pool.release(lnode);
+    touch(parent);
+
+    return true;
+}
+
+template <class Kernel>
+bool BasicBSPTree<Kernel>::remove(const Polyhedron_3 &poly) {
+    Index cell = store.find(poly.id());
+    if (!root || cell == Cells::NONE)
+        return false;
+
+    if (root->has_children()) {
+        if (!::remove(store, *pool, root, cell, root))
+            return false;
+        if (root)
+            root = ::rebalance(store, *pool, root, options, options.threads ? options.threads : default_threads());
+    }
+    else {
+        if (static_cast<LeafNode<Kernel>*>(root)->cell != cell)
+            return false;
+
+        pool->release(root);
+        root = NULL;
+    }
+
+    store.erase(cell);
+    return true;
+}
+
+template <class Kernel>
+std::size_t BasicBSPTree<Kernel>::insert(const std::vector<Polyhedron_3> &v) {
+    std::vector<Polyhedron_3> copies;
+    for (const Polyhedron_3 &poly : v) {
+        if (poly.is_valid() && store.find(poly.id()) == Cells::NONE)
+            copies.push_back(poly);
+    }
+    return insert(std::move(copies));
+}
+
+template <class Kernel>
+std::size_t BasicBSPTree<Kernel>::insert(std::vector<Polyhedron_3> &&v) {
+    if (!pool)
+        pool.reset(new NodePool<Kernel>);
+
+    std::vector<Index> cells;
+    for (Polyhedron_3 &poly : v) {
+        if (poly.is_valid() && store.find(poly.id()) == Cells::NONE)
+            cells.push_back(store.add(std::move(poly)));
+    }
+    std::size_t count = cells.size();
+    unsigned threads = options.threads ? options.threads : default_threads();
+
+    if (!root) {
+        try {
+            root = ::create_node(store, *pool, cells, options, options.seed, threads);
+        } catch (...) {
+            for (Index cell : cells)
+                store.erase(cell);
+            throw;
+        }
+        store.connect(cells, root);
+        return count;
+    }
+
+    std::vector<Index> added(cells);
+    std::vector<std::pair<InternalNode<Kernel>*, Index> > boundary;
+    std::vector<InsertBatch<Kernel> > batches;
+    classify_insert(store, root, cells, boundary, batches);
+
+    // nothing is linked into the tree before every subtree is built, so a
+    // failure only has to release the new nodes
+    try {
+        auto build = [&](std::size_t i, unsigned build_threads) {
+            InsertBatch<Kernel> &batch = batches[i];
+            batch.cells.push_back(batch.leaf->cell);
+            batch.subtree = ::create_node(store, *pool, batch.cells, options,
+                    mix_seed(options.seed, i + 1), build_threads);
+        };
+        if (threads > 1 && batches.size() > 1)
+            parallel_for(batches.size(), 1, threads, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i)
+                    build(i, 1);
+            });
+        else {
+            for (std::size_t i = 0; i < batches.size(); ++i)
+                build(i, threads);
+        }
+    } catch (...) {
+        for (InsertBatch<Kernel> &batch : batches)
+            pool->release_tree(batch.subtree);
+        for (Index cell : added)
+            store.erase(cell);
+        throw;
+    }
+
+    for (const std::pair<InternalNode<Kernel>*, Index> &b : boundary)
+        b.first->polys.push_back(b.second);
+
+    for (InsertBatch<Kernel> &batch : batches) {
+        InternalNode<Kernel> *parent = batch.leaf->parent;
+        batch.subtree->parent = parent;
+        if (!parent)
+            root = batch.subtree;
+        else if (parent->left == batch.leaf)
+            parent->left = batch.subtree;
+        else parent->right = batch.subtree;
+        pool->release(batch.leaf);
+        touch(parent);
+    }
+    root = ::rebalance(store, *pool, root, options, threads);
+    store.connect(added, root);
+
+    return count;
+}
+
+// Sends the cells down from node, recording the internal nodes whose
+// planes they touch and, per leaf reached, the cells reaching it. Cells
+// crossing a plane go down both sides.
+template <class Kernel>
+void classify_insert(const CellStore<Kernel> &store, Node<Kernel> *node, std::vector<Index> &cells,
+        std::vector<std::pair<InternalNode<Kernel>*, Index> > &boundary, std::vector<InsertBatch<Kernel> > &batches) {
+    if (cells.empty())
+        return;
+
+    if (!node->has_children()) {
+        InsertBatch<Kernel> batch;
+        batch.leaf = static_cast<LeafNode<Kernel>*>(node);
+        batch.cells.swap(cells);
+        batch.subtree = NULL;
+        batches.push_back(std::move(batch));
+        return;
+    }
+
+    InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+    std::vector<Index> left, right;
+    for (Index cell : cells) {
+        int side = oriented_side(inode->plane, inode->fplane, store.cell(cell)),
+            l = side & ON_NEGATIVE_SIDE,
+            r = side & ON_POSITIVE_SIDE;
+
+        if (on_boundary(side))
+            boundary.push_back(std::make_pair(inode, cell));
+        if (l)
+            left.push_back(cell);
+        if (r || !l)
+            right.push_back(cell);
+    }
+    std::vector<Index>().swap(cells);
+
+    classify_insert(store, inode->left, left, boundary, batches);
+    classify_insert(store, inode->right, right, boundary, batches);
+}
+
+template <class Kernel>
+std::size_t BasicBSPTree<Kernel>::remove(const std::vector<Polyhedron_3> &v) {
+    std::vector<Index> cells;
+    for (const Polyhedron_3 &poly : v) {
+        Index cell = store.find(poly.id());
+        if (cell != Cells::NONE)
+            cells.push_back(cell);
+    }
+    std::sort(cells.begin(), cells.end());
+    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+    if (!root || cells.empty())
+        return 0;
+
+    root = remove_batch(store, *pool, root, cells);
+    if (root) {
+        root->parent = NULL;
+        root = ::rebalance(store, *pool, root, options, options.threads ? options.threads : default_threads());
+    }
+
+    for (Index cell : cells)
+        store.erase(cell);
+    return cells.size();
+}
+
+// Removes the sorted cells from the subtree. Returns the node replacing the
+// subtree, or NULL if nothing is left of it: an internal node losing a child
+// is replaced by the other child.
+template <class Kernel>
+Node<Kernel>* remove_batch(const CellStore<Kernel> &store, NodePool<Kernel> &pool, Node<Kernel> *node,
+        const std::vector<Index> &cells) {
+    if (cells.empty())
+        return node;
+
+    if (!node->has_children()) {
+        LeafNode<Kernel> *lnode = static_cast<LeafNode<Kernel>*>(node);
+        if (!std::binary_search(cells.begin(), cells.end(), lnode->cell))
+            return node;
+        pool.release(lnode);
+        return NULL;
+    }
+
+    InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+    std::vector<Index> left, right;
+    bool touching = false;
+    for (Index cell : cells) {
+        int side = oriented_side(inode->plane, inode->fplane, store.cell(cell)),
+            l = side & ON_NEGATIVE_SIDE,
+            r = side & ON_POSITIVE_SIDE;
+
+        touching |= on_boundary(side);
+        if (l)
+            left.push_back(cell);
+        if (r || !l)
+            right.push_back(cell);
+    }
+    if (touching) {
+        inode->polys.erase(std::remove_if(inode->polys.begin(), inode->polys.end(), [&](Index cell) {
+            return std::binary_search(cells.begin(), cells.end(), cell);
+        }), inode->polys.end());
+    }
+
+    // both stay sorted
+    Node<Kernel> *l = remove_batch(store, pool, inode->left, left),
+        *r = remove_batch(store, pool, inode->right, right);
+    if (l && r) {
+        inode->left = l;
+        inode->right = r;
+        l->parent = r->parent = inode;
+        inode->update();
+        ++inode->changes;
+        inode->dirty = true;
+        return inode;
+    }
+
+    pool.release(inode);
+    return l ? l : r;
+}
+
+// Updates the weights and boxes from node up to the root after a subtree
+// below node was replaced, and marks the path for rebalance().
+template <class Kernel>
+void touch(InternalNode<Kernel> *node) {
+    for (; node; node = node->parent) {
+        node->update();
+        ++node->changes;
+        node->dirty = true;
+    }
+}
+
+// Walks the paths marked by touch() from the top and rebuilds the highest
+// subtrees that are out of balance, as in a scapegoat tree. A subtree is
+// only rebuilt once it has seen updates amounting to half its leaves, which
+// pays for the rebuild even where the cells cannot be split evenly. Returns
+// the node replacing node.
+template <class Kernel>
+Node<Kernel>* rebalance(const CellStore<Kernel> &store, NodePool<Kernel> &pool, Node<Kernel> *node,
+        const BuildOptions &options, unsigned threads) {
+    if (!node->dirty)
+        return node;
+    node->dirty = false;
+
+    InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+    std::size_t heavy = std::max(inode->left->weight, inode->right->weight);
+    if (heavy > options.rebalance_alpha * inode->weight && 2 * inode->changes >= inode->weight) {
+        std::vector<Index> cells;
+        std::stack<Node<Kernel>*> nodes;
+        nodes.push(inode);
+        while (!nodes.empty()) {
+            Node<Kernel> *n = nodes.top();
+            nodes.pop();
+            if (n->has_children()) {
+                nodes.push(static_cast<InternalNode<Kernel>*>(n)->left);
+                nodes.push(static_cast<InternalNode<Kernel>*>(n)->right);
+            }
+            else cells.push_back(static_cast<LeafNode<Kernel>*>(n)->cell);
+        }
+        // cells crossing planes of the subtree sit in several leaves
+        std::sort(cells.begin(), cells.end());
+        cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+
+        try {
+            Node<Kernel> *subtree = create_node(store, pool, cells, options, mix_seed(options.seed, inode->weight), threads);
+            subtree->parent = inode->parent;
+            pool.release_tree(inode);
+            return subtree;
+        } catch (const std::runtime_error &) {
+            // the old subtree is still correct, only deeper than it could be
+        }
+    }
+
+    Node<Kernel> *left = rebalance(store, pool, inode->left, options, threads),
+        *right = rebalance(store, pool, inode->right, options, threads);
+    inode->left = left;
+    inode->right = right;
+    left->parent = right->parent = inode;
+    inode->update();
+    return inode;
+}
+
+template <class Kernel>
+const typename BasicBSPTree<Kernel>::Cells& BasicBSPTree<Kernel>::cells() const {
+    return store;
+}
+
+// Approximate memory held by a cell and its mesh.
+template <class Kernel>
+std::size_t cell_bytes(const Cell<Kernel> &cell) {
+    typedef typename BasicPolyhedron_3<Kernel>::CGALPolyhedron_3 CGALPolyhedron_3;
+
+    return sizeof(Cell<Kernel>)
+        + cell.halfspaces.capacity() * sizeof(typename Kernel::Plane_3)
+        + cell.fhalfspaces.capacity() * sizeof(FilteredPlane)
+        + cell.fvertices.capacity() * sizeof(FilteredPoint)
+        + cell.poly.size_of_vertices() * sizeof(typename CGALPolyhedron_3::Vertex)
+        + cell.poly.size_of_halfedges() * sizeof(typename CGALPolyhedron_3::Halfedge)
+        + cell.poly.size_of_facets() * sizeof(typename CGALPolyhedron_3::Facet);
+}
+
+template <class Kernel>
+TreeStats BasicBSPTree<Kernel>::stats() const {
+    TreeStats res = TreeStats();
+    double depth_sum = 0, weighted_sum = 0, volume_sum = 0;
+    std::unordered_set<Index> counted;
+
+    std::stack<std::pair<Node<Kernel>*, std::size_t> > nodes;
+    if (root)
+        nodes.push(std::make_pair(root, 0));
+    while (!nodes.empty()) {
+        Node<Kernel> *node = nodes.top().first;
+        std::size_t depth = nodes.top().second;
+        nodes.pop();
+
+        ++res.nodes;
+        res.max_depth = std::max(res.max_depth, depth);
+
+        if (node->has_children()) {
+            InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+            nodes.push(std::make_pair(inode->left, depth + 1));
+            nodes.push(std::make_pair(inode->right, depth + 1));
+
+            res.boundary_total += inode->polys.size();
+            res.boundary_max = std::max(res.boundary_max, inode->polys.size());
+            res.node_bytes += sizeof(InternalNode<Kernel>) + inode->polys.capacity() * sizeof(Index);
+        }
+        else {
+            Index index = static_cast<LeafNode<Kernel>*>(node)->cell;
+            const Cell<Kernel> &cell = store.cell(index);
+            ++res.leaves;
+            depth_sum += depth;
+            weighted_sum += cell.volume * depth;
+            volume_sum += cell.volume;
+            res.node_bytes += sizeof(LeafNode<Kernel>);
+
+            // cells crossing planes sit in several leaves
+            if (counted.insert(index).second)
+                res.cell_bytes += cell_bytes(cell);
+        }
+    }
+
+    std::size_t internals = res.nodes - res.leaves;
+    res.average_depth = res.leaves ? depth_sum / res.leaves : 0;
+    res.expected_depth = volume_sum > 0 ? weighted_sum / volume_sum : res.average_depth;
+    res.boundary_average = internals ? double(res.boundary_total) / internals : 0;
+    return res;
+}
+
+template <class Kernel>
+bool BasicBSPTree<Kernel>::empty() const {
+    return !root;
+}
+
+template <class Kernel>
+void BasicBSPTree<Kernel>::clear() {
+    if (pool)
+        pool->clear();
+    root = NULL;
+    store.clear();
+}
+
+template <class Kernel>
+std::ostream& operator<<(std::ostream &out, const BasicBSPTree<Kernel> &t) {
+    return print(out, t.store, t.root, 0);
+}
+
+// FUNCTIONS
+
+template <class Kernel>
+bool point_in_polyhedron(const BasicPolyhedron_3<Kernel> &poly, const typename Kernel::Point_3 &p) {
+    for (auto it_plane = poly.planes_begin(); it_plane != poly.planes_end(); ++it_plane) {
+        CGAL::Oriented_side side = it_plane->oriented_side(p);
+        if (side == CGAL::ON_ORIENTED_BOUNDARY)
+            continue;
+
+        for (auto it_p = poly.points_begin(); it_p != poly.points_end(); ++it_p) {
+            CGAL::Oriented_side _side = it_plane->oriented_side(*it_p);
+            if (_side != CGAL::ON_ORIENTED_BOUNDARY && _side != side)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+template <class Kernel>
+int oriented_side(const typename Kernel::Plane_3 &plane, const BasicPolyhedron_3<Kernel> &poly) {
+    int res = 0, max = ON_NEGATIVE_SIDE + ON_ORIENTED_BOUNDARY + ON_POSITIVE_SIDE;
+    for (auto it = poly.points_begin(); it != poly.points_end() && res < max; ++it) {
+        switch (plane.oriented_side(*it)) {
+            case CGAL::ON_NEGATIVE_SIDE:
+                res |= ON_NEGATIVE_SIDE;
+                break;
+            case CGAL::ON_ORIENTED_BOUNDARY:
+                res |= ON_ORIENTED_BOUNDARY;
+                break;
+            case CGAL::ON_POSITIVE_SIDE:
+                res |= ON_POSITIVE_SIDE;
+        }
+    }
+
+    return res;
+}
+
+// The same as above, deciding the sides of most vertices in floating point.
+template <class Kernel>
+int oriented_side(const typename Kernel::Plane_3 &plane, const FilteredPlane &fplane, const Cell<Kernel> &cell) {
+    int res = 0, max = ON_NEGATIVE_SIDE + ON_ORIENTED_BOUNDARY + ON_POSITIVE_SIDE;
+    auto it = cell.poly.points_begin();
+    for (const FilteredPoint &fp : cell.fvertices) {
+        if (res == max)
+            break;
+
+        switch (oriented_side(fplane, plane, fp, *it++)) {
+            case CGAL::ON_NEGATIVE_SIDE:
+                res |= ON_NEGATIVE_SIDE;
+                break;
+            case CGAL::ON_ORIENTED_BOUNDARY:
+                res |= ON_ORIENTED_BOUNDARY;
+                break;
+            case CGAL::ON_POSITIVE_SIDE:
+                res |= ON_POSITIVE_SIDE;
+        }
+    }
+
+    return res;
+}
+
+template <class Plane, class Point>
+CGAL::Oriented_side oriented_side(const FilteredPlane &fplane, const Plane &plane,
+        const FilteredPoint &fp, const Point &p) {
+    CGAL::Oriented_side side;
+    if (fplane.oriented_side(fp, side))
+        return side;
+    return plane.oriented_side(p);
+}
+
+// The same, counting the tests the filter cannot decide.
+template <class Plane, class Point, class Counters>
+CGAL::Oriented_side oriented_side(const FilteredPlane &fplane, const Plane &plane,
+        const FilteredPoint &fp, const Point &p, Counters &counters) {
+    CGAL::Oriented_side side;
+    if (fplane.oriented_side(fp, side))
+        return side;
+    counters.exact();
+    return plane.oriented_side(p);
+}
+
+template <class Kernel, class Counters>
+bool cell_contains(const Cell<Kernel> &cell, const typename Kernel::Point_3 &p, const FilteredPoint &fp,
+        Counters &counters) {
+    counters.containment();
+    for (std::size_t i = 0; i < cell.halfspaces.size(); ++i) {
+        if (oriented_side(cell.fhalfspaces[i], cell.halfspaces[i], fp, p, counters) == CGAL::ON_POSITIVE_SIDE)
+            return false;
+    }
+
+    return true;
+}
+
+template <class Plane>
+void cache_exact(const Plane&) {}
+
+// Lazy kernels compute exact values on first use and store them inside
+// objects shared by all queries. Forcing that while the cells are stored
+// keeps concurrent queries and build threads free of writes.
+void cache_exact(const Epeck::Plane_3 &plane) {
+    CGAL::exact(plane);
+}
+
+void cache_exact(const Epeck::Point_3 &p) {
+    CGAL::exact(p);
+}
+
+// A point lying on a splitting plane is looked up among the cells that
+// touch the plane or cross it.
+bool on_boundary(int side) {
+    return (side & ON_ORIENTED_BOUNDARY) || ((side & ON_NEGATIVE_SIDE) && (side & ON_POSITIVE_SIDE));
+}
+
+// Sends the points packet[begin, end) down the subtree of node. The plane
+// of each node is evaluated for the whole range in one pass; only lanes the
+// filter cannot certify are tested exactly.
+template <class Kernel>
+void locate_packet(const CellStore<Kernel> &store, Node<Kernel> *node, Packet &packet,
+        std::size_t begin, std::size_t end, const typename Kernel::Point_3 *points, int *ids) {
+    if (begin == end)
+        return;
+
+    if (!node->has_children()) {
+        const Cell<Kernel> &cell = store.cell(static_cast<LeafNode<Kernel>*>(node)->cell);
+        for (std::size_t i = begin; i < end; ++i) {
+            std::size_t k = packet.index[i];
+            FilteredPoint fp(packet.x[i], packet.y[i], packet.z[i]);
+            ids[k] = cell.contains(points[k], fp) ? cell.poly.id() : -1;
+        }
+        return;
+    }
+
+    InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+    const FilteredPlane &fplane = inode->fplane;
+    for (std::size_t i = begin; i < end; ++i)
+        packet.side[i] = fplane.certain_side(packet.x[i], packet.y[i], packet.z[i]);
+
+    // lanes lying on the plane are answered from the boundary list and
+    // marked with 2
+    for (std::size_t i = begin; i < end; ++i) {
+        if (packet.side[i])
+            continue;
+
+        std::size_t k = packet.index[i];
+        switch (inode->plane.oriented_side(points[k])) {
+            case CGAL::ON_POSITIVE_SIDE:
+                packet.side[i] = 1;
+                break;
+            case CGAL::ON_NEGATIVE_SIDE:
+                packet.side[i] = -1;
+                break;
+            case CGAL::ON_ORIENTED_BOUNDARY: {
+                FilteredPoint fp(packet.x[i], packet.y[i], packet.z[i]);
+                auto found = std::find_if(inode->polys.begin(), inode->polys.end(),
+                        PointInPolyhedron<Kernel>(store, points[k], fp));
+                ids[k] = found == inode->polys.end() ? -1 : store[*found].id();
+                packet.side[i] = 2;
+            }
+        }
+    }
+
+    std::size_t last = end;
+    for (std::size_t i = begin; i < last; ) {
+        if (packet.side[i] == 2)
+            packet.swap(i, --last);
+        else ++i;
+    }
+
+    std::size_t mid = begin;
+    for (std::size_t i = begin; i < last; ++i) {
+        if (packet.side[i] < 0)
+            packet.swap(i, mid++);
+    }
+
+    locate_packet(store, inode->left, packet, begin, mid, points, ids);
+    locate_packet(store, inode->right, packet, mid, last, points, ids);
+}
+
+template <class Kernel>
+Node<Kernel>* split(const CellStore<Kernel> &store, NodePool<Kernel> &pool, Index cell1, Index cell2) {
+    // the cached half-spaces rather than the facet planes, whose exact
+    // values a lazy kernel would compute here, possibly in two build
+    // threads at once
+    const Cell<Kernel> &c1 = store.cell(cell1), &c2 = store.cell(cell2);
+
+    std::size_t i;
+    int side = separating_halfspace(c1, c2, i);
+    if (side) {
+        std::vector<Index> polys = { cell1 };
+        if (side & ON_ORIENTED_BOUNDARY)
+            polys.push_back(cell2);
+        if (side & ON_NEGATIVE_SIDE)
+            return pool.internal(pool.leaf(cell2, c2), pool.leaf(cell1, c1), c1.halfspaces[i], polys);
+        return pool.internal(pool.leaf(cell1, c1), pool.leaf(cell2, c2), c1.halfspaces[i], polys);
+    }
+
+    side = separating_halfspace(c2, c1, i);
+    if (side) {
+        std::vector<Index> polys = { cell2 };
+        if (side & ON_ORIENTED_BOUNDARY)
+            polys.push_back(cell1);
+        if (side & ON_NEGATIVE_SIDE)
+            return pool.internal(pool.leaf(cell1, c1), pool.leaf(cell2, c2), c2.halfspaces[i], polys);
+        return pool.internal(pool.leaf(cell2, c2), pool.leaf(cell1, c1), c2.halfspaces[i], polys);
+    }
+
+    //return new LeafNode<Kernel>(cell1);
+    throw std::runtime_error("Intersecting polyhedrons!");
+}
+
+// Looks for a half-space i of the cell with the other cell entirely on one
+// side of its plane, and returns that side, or 0 if there is none.
+template <class Kernel>
+int separating_halfspace(const Cell<Kernel> &cell, const Cell<Kernel> &other, std::size_t &i) {
+    for (i = 0; i < cell.halfspaces.size(); ++i) {
+        const typename Kernel::Plane_3 &plane = cell.halfspaces[i];
+        int side1 = oriented_side(plane, cell.fhalfspaces[i], cell),
+            side2 = oriented_side(plane, cell.fhalfspaces[i], other);
+        if (side1 == side2 || side1 - ON_ORIENTED_BOUNDARY == side2 || side1 == side2 - ON_ORIENTED_BOUNDARY)
+            continue;
+
+        switch (side2) {
+            case ON_NEGATIVE_SIDE + ON_ORIENTED_BOUNDARY:
+            case ON_NEGATIVE_SIDE:
+            case ON_POSITIVE_SIDE + ON_ORIENTED_BOUNDARY:
+            case ON_POSITIVE_SIDE:
+                return side2;
+        }
+    }
+    return 0;
+}
+
+// splitmix64 finaliser, used to give every node its own random stream so
+// that the tree does not depend on the order nodes are built in
+std::uint64_t mix_seed(std::uint64_t seed, std::uint64_t salt) {
+    std::uint64_t z = seed + 0x9e3779b97f4a7c15ULL * (salt + 1);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// The facet planes of the cells in input order, or a random sample of
+// options.max_candidates of them.
+template <class Kernel>
+std::vector<const typename Kernel::Plane_3*> split_candidates(const CellStore<Kernel> &store, const std::vector<Index> &v,
+        const BuildOptions &options, std::uint64_t seed) {
+    std::vector<const typename Kernel::Plane_3*> candidates;
+    for (Index cell : v) {
+        for (const typename Kernel::Plane_3 &plane : store.cell(cell).halfspaces)
+            candidates.push_back(&plane);
+    }
+
+    std::size_t max = options.max_candidates;
+    if (options.heuristic == SPLIT_FIRST || !max || candidates.size() <= max)
+        return candidates;
+
+    std::mt19937_64 rng(seed);
+    for (std::size_t i = 0; i < max; ++i) {
+        std::uniform_int_distribution<std::size_t> pick(i, candidates.size() - 1);
+        std::swap(candidates[i], candidates[pick(rng)]);
+    }
+    candidates.resize(max);
+
+    return candidates;
+}
+
+// Counts the cells on either side of every candidate plane from the
+// extents of the cells along the plane normals, in floating point. Parallel
+// planes share one pass over the cells; groups with many offsets sort the
+// extents once and answer every offset by binary search. Returns the
+// candidates ordered from best to worst, ties broken by input order;
+// duplicate planes are dropped.
+template <class Kernel>
+std::vector<SplitCandidate> score_candidates(const CellStore<Kernel> &store, const std::vector<Index> &v,
+        const std::vector<const typename Kernel::Plane_3*> &planes, const BuildOptions &options, unsigned threads) {
+    std::vector<SplitCandidate> candidates;
+    candidates.reserve(planes.size());
+    for (std::size_t i = 0; i < planes.size(); ++i) {
+        FilteredPlane fplane(*planes[i]);
+        double length = std::sqrt(fplane.a * fplane.a + fplane.b * fplane.b + fplane.c * fplane.c);
+        if (!(length > 0) || !std::isfinite(length))
+            continue;
+
+        double first = fplane.a != 0 ? fplane.a : fplane.b != 0 ? fplane.b : fplane.c;
+        double scale = first < 0 ? -1 / length : 1 / length;
+
+        SplitCandidate candidate;
+        candidate.nx = fplane.a * scale;
+        candidate.ny = fplane.b * scale;
+        candidate.nz = fplane.c * scale;
+        candidate.offset = -fplane.d * scale;
+        candidate.plane = i;
+        candidates.push_back(candidate);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const SplitCandidate &c1, const SplitCandidate &c2) {
+        if (c1.nx != c2.nx)
+            return c1.nx < c2.nx;
+        if (c1.ny != c2.ny)
+            return c1.ny < c2.ny;
+        if (c1.nz != c2.nz)
+            return c1.nz < c2.nz;
+        if (c1.offset != c2.offset)
+            return c1.offset < c2.offset;
+        return c1.plane < c2.plane;
+    });
+    candidates.erase(std::unique(candidates.begin(), candidates.end(), [](const SplitCandidate &c1, const SplitCandidate &c2) {
+        return c1.parallel(c2) && c1.offset == c2.offset;
+    }), candidates.end());
+
+    std::vector<std::size_t> groups;
+    for (std::size_t k = 0; k < candidates.size(); ++k) {
+        if (!k || !candidates[k].parallel(candidates[k - 1]))
+            groups.push_back(k);
+    }
+    groups.push_back(candidates.size());
+
+    std::size_t n = v.size();
+    auto score_groups = [&](std::size_t first_group, std::size_t last_group) {
+        // (extent, volume) of every cell
+        std::vector<std::pair<double, double> > lows(n), highs(n);
+        std::vector<double> low_volumes(n + 1), high_volumes(n + 1);
+        for (std::size_t g = first_group; g < last_group; ++g) {
+            std::size_t begin = groups[g], end = groups[g + 1];
+            const SplitCandidate &normal = candidates[begin];
+            for (std::size_t i = 0; i < n; ++i) {
+                const Cell<Kernel> &cell = store.cell(v[i]);
+                double low = std::numeric_limits<double>::infinity(), high = -low;
+                for (const FilteredPoint &fp : cell.fvertices) {
+                    double dot = normal.nx * fp.x + normal.ny * fp.y + normal.nz * fp.z;
+                    low = std::min(low, dot);
+                    high = std::max(high, dot);
+                }
+                lows[i] = std::make_pair(low, cell.volume);
+                highs[i] = std::make_pair(high, cell.volume);
+            }
+
+            // a cell is on the negative side if it extends below the offset and
+            // on the positive side if it extends above it
+            bool sweep = end - begin > 16;
+            if (sweep) {
+                std::sort(lows.begin(), lows.end());
+                std::sort(highs.begin(), highs.end());
+                for (std::size_t i = 0; i < n; ++i) {
+                    low_volumes[i + 1] = low_volumes[i] + lows[i].second;
+                    high_volumes[i + 1] = high_volumes[i] + highs[i].second;
+                }
+            }
+
+            for (std::size_t k = begin; k < end; ++k) {
+                SplitCandidate &candidate = candidates[k];
+                SplitCounts &counts = candidate.counts;
+                double offset = candidate.offset;
+
+                if (sweep) {
+                    std::size_t below = std::lower_bound(lows.begin(), lows.end(),
+                            std::make_pair(offset, -std::numeric_limits<double>::infinity())) - lows.begin();
+                    std::size_t above = std::upper_bound(highs.begin(), highs.end(),
+                            std::make_pair(offset, std::numeric_limits<double>::infinity())) - highs.begin();
+                    counts.left = below;
+                    counts.left_volume = low_volumes[below];
+                    counts.right = n - above;
+                    counts.right_volume = high_volumes[n] - high_volumes[above];
+                }
+                else {
+                    for (std::size_t i = 0; i < n; ++i) {
+                        if (lows[i].first < offset) {
+                            ++counts.left;
+                            counts.left_volume += lows[i].second;
+                        }
+                        if (highs[i].first > offset) {
+                            ++counts.right;
+                            counts.right_volume += highs[i].second;
+                        }
+                    }
+                }
+
+                counts.straddle = counts.left + counts.right > n ? counts.left + counts.right - n : 0;
+                candidate.score = split_score(counts, options);
+            }
+        }
+    };
+
+    if (threads > 1 && n >= PARALLEL_BUILD_GRAIN)
+        parallel_for(groups.size() - 1, 1, threads, score_groups);
+    else
+        score_groups(0, groups.size() - 1);
+
+    std::sort(candidates.begin(), candidates.end(), [](const SplitCandidate &c1, const SplitCandidate &c2) {
+        return c1.score < c2.score || (c1.score == c2.score && c1.plane < c2.plane);
+    });
+
+    return candidates;
+}
+
+// Distributes the cells over the plane exactly. Returns false if the plane
+// does not divide them.
+template <class Kernel>
+bool partition(const CellStore<Kernel> &store, const std::vector<Index> &v, const typename Kernel::Plane_3 &plane,
+        std::vector<Index> &left, std::vector<Index> &right, std::vector<Index> &polys) {
+    left.clear();
+    right.clear();
+    polys.clear();
+
+    FilteredPlane fplane(plane);
+    for (Index cell : v) {
+        int side = oriented_side(plane, fplane, store.cell(cell));
+        if (side & ON_NEGATIVE_SIDE)
+            left.push_back(cell);
+        if (side & ON_POSITIVE_SIDE)
+            right.push_back(cell);
+        if (on_boundary(side))
+            polys.push_back(cell);
+    }
+
+    return left.size() && left.size() < v.size() && right.size() && right.size() < v.size();
+}
+
+// Lower is better.
+double split_score(const SplitCounts &counts, const BuildOptions &options) {
+    double imbalance = std::fabs((double) counts.left - (double) counts.right);
+
+    switch (options.heuristic) {
+        case SPLIT_FIRST:
+            return 0;
+        case SPLIT_BALANCE:
+            return options.balance_weight * imbalance + options.straddle_weight * counts.straddle;
+        case SPLIT_MIN_STRADDLE:
+            return counts.straddle * (double) (counts.left + counts.right + 1) + imbalance;
+        case SPLIT_SAH:
+            break;
+    }
+
+    double volume = counts.left_volume + counts.right_volume;
+    if (!(volume > 0))
+        return options.traversal_cost + 0.5 * (counts.left + counts.right);
+    return options.traversal_cost
+        + (counts.left_volume * counts.left + counts.right_volume * counts.right) / volume;
+}
+
+template <class Kernel>
+Node<Kernel>* create_node(const CellStore<Kernel> &store, NodePool<Kernel> &pool, const std::vector<Index> &v,
+        const BuildOptions &options, std::uint64_t seed, unsigned threads) {
+    typedef typename Kernel::Plane_3 Plane_3;
+
+    std::size_t size = v.size();
+    switch (size) {
+        case 0:
+            return NULL;
+        case 1:
+            return pool.leaf(v[0], store.cell(v[0]));
+        case 2:
+            return split(store, pool, v[0], v[1]);
+    }
+
+    // the scores are estimates, so every plane is checked exactly before
+    // it is used
+    std::vector<Index> left, right;
+    std::vector<Index> polys;
+    const Plane_3 *plane = NULL;
+    if (options.heuristic != SPLIT_FIRST) {
+        std::vector<const Plane_3*> planes = split_candidates(store, v, options, seed);
+        for (const SplitCandidate &candidate : score_candidates(store, v, planes, options, threads)) {
+            if (candidate.counts.divides(size) && partition(store, v, *planes[candidate.plane], left, right, polys)) {
+                plane = planes[candidate.plane];
+                break;
+            }
+        }
+    }
+
+    // a sample may miss every dividing plane; take the first one
+    if (!plane) {
+        BuildOptions first = options;
+        first.heuristic = SPLIT_FIRST;
+        for (const Plane_3 *candidate : split_candidates(store, v, first, seed)) {
+            if (partition(store, v, *candidate, left, right, polys)) {
+                plane = candidate;
+                break;
+            }
+        }
+    }
+
+    if (!plane)
+        throw std::runtime_error("Intersecting polyhedrons!");
+
+    // the subtrees only read the store, and every node derives its seed
+    // from its parent's, so they can be built in any order
+    Node<Kernel> *node_left, *node_right;
+    if (threads > 1 && size >= PARALLEL_BUILD_GRAIN) {
+        unsigned left_threads = threads / 2;
+        std::future<Node<Kernel>*> future = std::async(std::launch::async, [&]() {
+            return create_node(store, pool, left, options, mix_seed(seed, 1), left_threads);
+        });
+
+        try {
+            node_right = create_node(store, pool, right, options, mix_seed(seed, 2), threads - left_threads);
+        } catch (...) {
+            try {
+                pool.release_tree(future.get());
+            } catch (...) {}
+            throw;
+        }
+
+        try {
+            node_left = future.get();
+        } catch (...) {
+            pool.release_tree(node_right);
+            throw;
+        }
+    }
+    else {
+        node_left = create_node(store, pool, left, options, mix_seed(seed, 1), 1);
+        left.clear();
+        try {
+            node_right = create_node(store, pool, right, options, mix_seed(seed, 2), 1);
+        } catch (...) {
+            pool.release_tree(node_left);
+            throw;
+        }
+    }
+
+    return pool.internal(node_left, node_right, *plane, polys);
+}
+
+template <class Kernel>
+std::ostream& print(std::ostream &out, const CellStore<Kernel> &store, Node<Kernel> *node, int depth) {
     if (!node)
         return out;
     if (!node->has_children())
         return out << std::setw(depth) << std::setfill('+') << ""
-            << static_cast<LeafNode*>(node)->poly.id() << std::endl;
-    InternalNode *inode = static_cast<InternalNode*>(node);
-    print(out, inode->left, depth+1);
-    return print(out, inode->right, depth+1);
+            << store[static_cast<LeafNode<Kernel>*>(node)->cell].id() << std::endl;
+    InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+    print(out, store, inode->left, depth+1);
+    return print(out, store, inode->right, depth+1);
+}
+
+// CLASS BasicFrozenBSPTree
+
+// Layout of a tree file: a FrozenHeader followed by the sections, each
+// starting at a multiple of 8 bytes. All integers are in the byte order of
+// the machine that wrote the file, which load() checks.
+enum FrozenSection {
+    SECTION_NODES,
+    SECTION_FPLANES,
+    SECTION_BOUNDARY_BEGIN,
+    SECTION_BOUNDARY,
+    SECTION_CELL_BEGIN,
+    SECTION_FHALFSPACES,
+    SECTION_CELL_IDS,
+    SECTION_PLANE_OFFSETS,
+    SECTION_HALFSPACE_OFFSETS,
+    SECTION_EXACT,
+    SECTIONS
+};
+
+struct FrozenHeader {
+    static const std::uint32_t VERSION = 1;
+    static const std::uint32_t ENDIAN = 0x01020304;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t kernel;
+    std::uint32_t endian;
+    std::uint32_t reserved;
+    // byte offset and number of elements of every section
+    std::uint64_t offset[SECTIONS];
+    std::uint64_t count[SECTIONS];
+};
+
+const char FROZEN_MAGIC[8] = { 'B', 'S', 'P', 'T', 'R', 'E', 'E', '\0' };
+
+template <class Kernel>
+std::uint32_t kernel_id();
+
+template <>
+std::uint32_t kernel_id<Gmpq_kernel>() {
+    return 1;
+}
+
+template <>
+std::uint32_t kernel_id<Epick>() {
+    return 2;
+}
+
+template <>
+std::uint32_t kernel_id<Epeck>() {
+    return 3;
+}
+
+// Exact coefficients are stored one after another. Doubles are copied
+// bytewise; rationals are written in decimal "n/d" form prefixed by their
+// length, which every exact number type of CGAL reads back.
+
+void write_exact(std::string &out, double x) {
+    out.append(reinterpret_cast<const char*>(&x), sizeof(x));
+}
+
+void write_rational(std::string &out, const std::string &text) {
+    std::uint32_t length = text.size();
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.append(text);
+}
+
+void write_exact(std::string &out, const CGAL::Gmpq &x) {
+    std::ostringstream os;
+    os << x;
+    write_rational(out, os.str());
+}
+
+void write_exact(std::string &out, const Epeck::FT &x) {
+    std::ostringstream os;
+    os << CGAL::exact(x);
+    write_rational(out, os.str());
+}
+
+void read_exact(const char *&in, double &x) {
+    std::memcpy(&x, in, sizeof(x));
+    in += sizeof(x);
+}
+
+template <class Rational>
+void read_rational(const char *&in, Rational &x) {
+    std::uint32_t length;
+    std::memcpy(&length, in, sizeof(length));
+    in += sizeof(length);
+
+    std::istringstream is(std::string(in, length));
+    if (!(is >> x) || is.peek() != std::char_traits<char>::eof())
+        throw std::runtime_error("Invalid exact number in tree file!");
+    in += length;
+}
+
+void read_exact(const char *&in, CGAL::Gmpq &x) {
+    read_rational(in, x);
+}
+
+void read_exact(const char *&in, Epeck::FT &x) {
+    Epeck::FT::ET et;
+    read_rational(in, et);
+    x = Epeck::FT(et);
+}
+
+// Step over a number written by write_exact() for the type of the last
+// argument. Return false if it does not end by end or is not a finite
+// number in the form write_exact() gives it.
+bool skip_exact(const char *&in, const char *end, const double&) {
+    double x;
+    if (std::size_t(end - in) < sizeof(x))
+        return false;
+    read_exact(in, x);
+    return std::isfinite(x);
+}
+
+// Decimal "n/d" or "n" with d > 0, which the rational types read without
+// failing or dividing by zero.
+bool rational_text(const char *begin, const char *end) {
+    if (begin != end && *begin == '-')
+        ++begin;
+    const char *digits = begin;
+    while (begin != end && *begin >= '0' && *begin <= '9')
+        ++begin;
+    if (begin == digits)
+        return false;
+    if (begin == end)
+        return true;
+    if (*begin++ != '/')
+        return false;
+
+    bool positive = false;
+    for (digits = begin; begin != end && *begin >= '0' && *begin <= '9'; ++begin)
+        positive |= *begin != '0';
+    return begin == end && begin != digits && positive;
+}
+
+bool skip_rational(const char *&in, const char *end) {
+    std::uint32_t length;
+    if (std::size_t(end - in) < sizeof(length))
+        return false;
+    std::memcpy(&length, in, sizeof(length));
+    in += sizeof(length);
+    if (std::size_t(end - in) < length || !rational_text(in, in + length))
+        return false;
+    in += length;
+    return true;
+}
+
+bool skip_exact(const char *&in, const char *end, const CGAL::Gmpq&) {
+    return skip_rational(in, end);
+}
+
+bool skip_exact(const char *&in, const char *end, const Epeck::FT&) {
+    return skip_rational(in, end);
+}
+
+template <class Plane>
+void write_plane(std::string &out, const Plane &plane) {
+    write_exact(out, plane.a());
+    write_exact(out, plane.b());
+    write_exact(out, plane.c());
+    write_exact(out, plane.d());
+}
+
+template <class T>
+void write_section(std::ostream &out, FrozenHeader &header, FrozenSection section, const T *data, std::size_t count) {
+    static const char padding[8] = {};
+    std::uint64_t offset = out.tellp();
+    if (offset % 8) {
+        out.write(padding, 8 - offset % 8);
+        offset += 8 - offset % 8;
+    }
+
+    header.offset[section] = offset;
+    header.count[section] = count;
+    out.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+template <class Kernel>
+BasicFrozenBSPTree<Kernel>::BasicFrozenBSPTree() : exact(NULL) {}
+
+template <class Kernel>
+BasicFrozenBSPTree<Kernel>::BasicFrozenBSPTree(const BasicBSPTree<Kernel> &tree) : exact(NULL) {
+    if (tree.empty())
+        return;
+
+    const CellStore<Kernel> &store = tree.store;
+    std::unordered_map<Index, std::uint32_t> frozen_cells;
+    auto freeze_cell = [&](Index cell) {
+        auto found = frozen_cells.find(cell);
+        if (found != frozen_cells.end())
+            return found->second;
+
+        const Cell<Kernel> &c = store.cell(cell);
+        std::uint32_t index = owned.cell_ids.size();
+        owned.cell_ids.push_back(c.poly.id());
+        owned.halfspaces.insert(owned.halfspaces.end(), c.halfspaces.begin(), c.halfspaces.end());
+        owned.fhalfspaces.insert(owned.fhalfspaces.end(), c.fhalfspaces.begin(), c.fhalfspaces.end());
+        owned.cell_begin.push_back(owned.halfspaces.size());
+        frozen_cells[cell] = index;
+        return index;
+    };
+
+    owned.cell_begin.push_back(0);
+    owned.boundary_begin.push_back(0);
+
+    // nodes[i] is made from order[i]; children are appended in pairs
+    std::vector<Node<Kernel>*> order(1, tree.root);
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        FrozenNode node;
+        if (!order[i]->has_children()) {
+            node.link = FrozenNode::LEAF | freeze_cell(static_cast<LeafNode<Kernel>*>(order[i])->cell);
+            node.plane = 0;
+            owned.nodes.push_back(node);
+            continue;
+        }
+
+        InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(order[i]);
+        node.link = order.size();
+        node.plane = owned.planes.size();
+        owned.nodes.push_back(node);
+
+        owned.planes.push_back(inode->plane);
+        owned.fplanes.push_back(inode->fplane);
+        for (Index cell : inode->polys)
+            owned.boundary.push_back(freeze_cell(cell));
+        owned.boundary_begin.push_back(owned.boundary.size());
+
+        order.push_back(inode->left);
+        order.push_back(inode->right);
+    }
+
+    bind();
+}
+
+template <class Kernel>
+void BasicFrozenBSPTree<Kernel>::bind() {
+    nodes = owned.nodes;
+    fplanes = owned.fplanes;
+    boundary_begin = owned.boundary_begin;
+    boundary = owned.boundary;
+    cell_begin = owned.cell_begin;
+    fhalfspaces = owned.fhalfspaces;
+    cell_ids = owned.cell_ids;
+}
+
+template <class Kernel>
+void BasicFrozenBSPTree<Kernel>::save(const std::string &filename) const {
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out)
+        throw std::runtime_error("Cannot open file '" + filename + "'!");
+
+    // exact coefficients, from memory or copied from the mapped file
+    std::string blob;
+    std::vector<std::uint64_t> offsets[2];
+    std::size_t counts[2] = { fplanes.size, fhalfspaces.size };
+    const std::vector<Plane_3> *exact_planes[2] = { &owned.planes, &owned.halfspaces };
+    const View<std::uint64_t> *exact_offsets[2] = { &plane_offsets, &halfspace_offsets };
+    for (int k = 0; k < 2; ++k) {
+        for (std::size_t i = 0; i < counts[k]; ++i) {
+            offsets[k].push_back(blob.size());
+            if (file.empty())
+                write_plane(blob, (*exact_planes[k])[i]);
+            else
+                blob.append(exact + (*exact_offsets[k])[i], (*exact_offsets[k])[i + 1] - (*exact_offsets[k])[i]);
+        }
+        offsets[k].push_back(blob.size());
+    }
+
+    FrozenHeader header = FrozenHeader();
+    std::copy(FROZEN_MAGIC, FROZEN_MAGIC + 8, header.magic);
+    header.version = FrozenHeader::VERSION;
+    header.kernel = kernel_id<Kernel>();
+    header.endian = FrozenHeader::ENDIAN;
+
+    // the header is written again once the offsets are known
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_section(out, header, SECTION_NODES, nodes.data, nodes.size);
+    write_section(out, header, SECTION_FPLANES, fplanes.data, fplanes.size);
+    write_section(out, header, SECTION_BOUNDARY_BEGIN, boundary_begin.data, boundary_begin.size);
+    write_section(out, header, SECTION_BOUNDARY, boundary.data, boundary.size);
+    write_section(out, header, SECTION_CELL_BEGIN, cell_begin.data, cell_begin.size);
+    write_section(out, header, SECTION_FHALFSPACES, fhalfspaces.data, fhalfspaces.size);
+    write_section(out, header, SECTION_CELL_IDS, cell_ids.data, cell_ids.size);
+    write_section(out, header, SECTION_PLANE_OFFSETS, offsets[0].data(), offsets[0].size());
+    write_section(out, header, SECTION_HALFSPACE_OFFSETS, offsets[1].data(), offsets[1].size());
+    write_section(out, header, SECTION_EXACT, blob.data(), blob.size());
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    if (!out.flush())
+        throw std::runtime_error("Cannot write file '" + filename + "'!");
+}
+
+template <class Kernel>
+BasicFrozenBSPTree<Kernel> BasicFrozenBSPTree<Kernel>::load(const std::string &filename) {
+    BasicFrozenBSPTree tree;
+    tree.file = MappedFile(filename);
+
+    const char *data = tree.file.data();
+    std::size_t size = tree.file.size();
+    const std::string invalid = "Invalid tree file '" + filename + "'!";
+
+    FrozenHeader header;
+    if (size < sizeof(header))
+        throw std::runtime_error(invalid);
+    std::memcpy(&header, data, sizeof(header));
+    if (!std::equal(FROZEN_MAGIC, FROZEN_MAGIC + 8, header.magic) || header.endian != FrozenHeader::ENDIAN)
+        throw std::runtime_error(invalid);
+    if (header.version != FrozenHeader::VERSION)
+        throw std::runtime_error("Unsupported version of tree file '" + filename + "'!");
+    if (header.kernel != kernel_id<Kernel>())
+        throw std::runtime_error("Tree file '" + filename + "' was written for another kernel!");
+
+    std::size_t element_size[SECTIONS] = {
+        sizeof(FrozenNode), sizeof(FilteredPlane), sizeof(std::uint32_t), sizeof(std::uint32_t),
+        sizeof(std::uint32_t), sizeof(FilteredPlane), sizeof(int), sizeof(std::uint64_t),
+        sizeof(std::uint64_t), 1
+    };
+    for (int section = 0; section < SECTIONS; ++section) {
+        std::uint64_t offset = header.offset[section], count = header.count[section];
+        if (offset % 8 || offset > size || count > (size - offset) / element_size[section])
+            throw std::runtime_error(invalid);
+    }
+
+    // the mapping is page aligned, so every section is aligned for its type
+    auto section = [&](FrozenSection section) {
+        return data + header.offset[section];
+    };
+    tree.nodes = View<FrozenNode>(reinterpret_cast<const FrozenNode*>(section(SECTION_NODES)), header.count[SECTION_NODES]);
+    tree.fplanes = View<FilteredPlane>(reinterpret_cast<const FilteredPlane*>(section(SECTION_FPLANES)), header.count[SECTION_FPLANES]);
+    tree.boundary_begin = View<std::uint32_t>(reinterpret_cast<const std::uint32_t*>(section(SECTION_BOUNDARY_BEGIN)),
+            header.count[SECTION_BOUNDARY_BEGIN]);
+    tree.boundary = View<std::uint32_t>(reinterpret_cast<const std::uint32_t*>(section(SECTION_BOUNDARY)),
+            header.count[SECTION_BOUNDARY]);
+    tree.cell_begin = View<std::uint32_t>(reinterpret_cast<const std::uint32_t*>(section(SECTION_CELL_BEGIN)),
+            header.count[SECTION_CELL_BEGIN]);
+    tree.fhalfspaces = View<FilteredPlane>(reinterpret_cast<const FilteredPlane*>(section(SECTION_FHALFSPACES)),
+            header.count[SECTION_FHALFSPACES]);
+    tree.cell_ids = View<int>(reinterpret_cast<const int*>(section(SECTION_CELL_IDS)), header.count[SECTION_CELL_IDS]);
+    tree.plane_offsets = View<std::uint64_t>(reinterpret_cast<const std::uint64_t*>(section(SECTION_PLANE_OFFSETS)),
+            header.count[SECTION_PLANE_OFFSETS]);
+    tree.halfspace_offsets = View<std::uint64_t>(reinterpret_cast<const std::uint64_t*>(section(SECTION_HALFSPACE_OFFSETS)),
+            header.count[SECTION_HALFSPACE_OFFSETS]);
+    tree.exact = section(SECTION_EXACT);
+
+    if (!tree.valid(header.count[SECTION_EXACT]))
+        throw std::runtime_error(invalid);
+
+    return tree;
+}
+
+// Checks that queries stay inside the arrays of a mapped file: every index
+// is checked against the array it indexes, begin arrays and offsets must
+// not decrease, children must follow their parents, so that every descent
+// ends, and the exact coefficients of every plane must fill its range with
+// four numbers that read back.
+template <class Kernel>
+bool BasicFrozenBSPTree<Kernel>::valid(std::size_t exact_size) const {
+    auto ascending = [](const std::uint32_t *begin, std::size_t count, std::size_t last) {
+        if (!count || begin[0] != 0 || begin[count - 1] != last)
+            return false;
+        for (std::size_t i = 1; i < count; ++i) {
+            if (begin[i] < begin[i - 1])
+                return false;
+        }
+        return true;
+    };
+    auto exact_ranges = [&](const View<std::uint64_t> &offsets, std::size_t count) {
+        if (offsets.size != count + 1 || offsets[count] > exact_size)
+            return false;
+        const FT unused(0);
+        for (std::size_t i = 0; i < count; ++i) {
+            if (offsets[i + 1] < offsets[i])
+                return false;
+            const char *in = exact + offsets[i], *end = exact + offsets[i + 1];
+            for (int k = 0; k < 4; ++k) {
+                if (!skip_exact(in, end, unused))
+                    return false;
+            }
+            if (in != end)
+                return false;
+        }
+        return true;
+    };
+
+    if (!exact_ranges(plane_offsets, fplanes.size) || !exact_ranges(halfspace_offsets, fhalfspaces.size))
+        return false;
+    // an empty tree is never descended
+    if (!nodes.size)
+        return true;
+
+    if (boundary_begin.size != fplanes.size + 1 || !ascending(boundary_begin.data, boundary_begin.size, boundary.size)
+            || cell_begin.size != cell_ids.size + 1 || !ascending(cell_begin.data, cell_begin.size, fhalfspaces.size))
+        return false;
+    for (std::size_t i = 0; i < boundary.size; ++i) {
+        if (boundary[i] >= cell_ids.size)
+            return false;
+    }
+    for (std::size_t i = 0; i < nodes.size; ++i) {
+        const FrozenNode &node = nodes[i];
+        if (node.link & FrozenNode::LEAF) {
+            if ((node.link & ~FrozenNode::LEAF) >= cell_ids.size)
+                return false;
+        }
+        else if (node.link <= i || node.link >= nodes.size - 1 || node.plane >= fplanes.size)
+            return false;
+    }
+    return true;
+}
+
+template <class Kernel>
+CGAL::Oriented_side BasicFrozenBSPTree<Kernel>::exact_side(const std::vector<Plane_3> &planes,
+        const View<std::uint64_t> &offsets, std::uint32_t i, const Point_3 &p) const {
+    if (file.empty())
+        return planes[i].oriented_side(p);
+
+    const char *in = exact + offsets[i];
+    FT a, b, c, d;
+    read_exact(in, a);
+    read_exact(in, b);
+    read_exact(in, c);
+    read_exact(in, d);
+    return Plane_3(a, b, c, d).oriented_side(p);
+}
+
+template <class Kernel>
+template <class Counters>
+CGAL::Oriented_side BasicFrozenBSPTree<Kernel>::plane_side(std::uint32_t plane, const Point_3 &p, const FilteredPoint &fp,
+        Counters &counters) const {
+    CGAL::Oriented_side side;
+    if (fplanes[plane].oriented_side(fp, side))
+        return side;
+    counters.exact();
+    return exact_side(owned.planes, plane_offsets, plane, p);
+}
+
+template <class Kernel>
+template <class Counters>
+bool BasicFrozenBSPTree<Kernel>::contains(std::uint32_t cell, const Point_3 &p, const FilteredPoint &fp,
+        Counters &counters) const {
+    counters.containment();
+    for (std::uint32_t i = cell_begin[cell]; i < cell_begin[cell + 1]; ++i) {
+        CGAL::Oriented_side side;
+        if (!fhalfspaces[i].oriented_side(fp, side)) {
+            counters.exact();
+            side = exact_side(owned.halfspaces, halfspace_offsets, i, p);
+        }
+        if (side == CGAL::ON_POSITIVE_SIDE)
+            return false;
+    }
+
+    return true;
+}
+
+template <class Kernel>
+int BasicFrozenBSPTree<Kernel>::locate(const Point_3 &p) const {
+    NoQueryCounters counters;
+    return find(p, counters);
+}
+
+template <class Kernel>
+int BasicFrozenBSPTree<Kernel>::locate(const Point_3 &p, QueryStats &stats) const {
+    ++stats.queries;
+    QueryCounters counters(stats);
+    return find(p, counters);
+}
+
+template <class Kernel>
+template <class Counters>
+int BasicFrozenBSPTree<Kernel>::find(const Point_3 &p, Counters &counters) const {
+    if (empty())
+        return -1;
+
+    FilteredPoint fp(p);
+    const FrozenNode *node = &nodes[0];
+    while (!(node->link & FrozenNode::LEAF)) {
+        std::uint32_t plane = node->plane;
+        counters.plane();
+        switch (plane_side(plane, p, fp, counters)) {
+            case CGAL::ON_POSITIVE_SIDE:
+                node = &nodes[node->link + 1];
+                break;
+            case CGAL::ON_NEGATIVE_SIDE:
+                node = &nodes[node->link];
+                break;
+            case CGAL::ON_ORIENTED_BOUNDARY:
+                for (std::uint32_t i = boundary_begin[plane]; i < boundary_begin[plane + 1]; ++i) {
+                    if (contains(boundary[i], p, fp, counters))
+                        return cell_ids[boundary[i]];
+                }
+                return -1;
+        }
+    }
+
+    std::uint32_t cell = node->link & ~FrozenNode::LEAF;
+    return contains(cell, p, fp, counters) ? cell_ids[cell] : -1;
+}
+
+template <class Kernel>
+void BasicFrozenBSPTree<Kernel>::locate_batch(const Point_3 *points, std::size_t n, int *ids) const {
+    if (empty()) {
+        std::fill(ids, ids + n, -1);
+        return;
+    }
+
+    // the same walk as locate_packet(), with the recursion unrolled onto
+    // a stack of (node, begin, end)
+    struct Range {
+        std::uint32_t node;
+        std::size_t begin, end;
+    };
+
+    Packet packet(std::min(n, PACKET_SIZE));
+    std::vector<Range> ranges;
+    NoQueryCounters counters;
+    for (std::size_t start = 0; start < n; start += PACKET_SIZE) {
+        std::size_t size = std::min(PACKET_SIZE, n - start);
+        const Point_3 *packet_points = points + start;
+        int *packet_ids = ids + start;
+        for (std::size_t i = 0; i < size; ++i) {
+            const Point_3 &p = packet_points[i];
+            packet.x[i] = CGAL::to_double(p.x());
+            packet.y[i] = CGAL::to_double(p.y());
+            packet.z[i] = CGAL::to_double(p.z());
+            packet.index[i] = i;
+        }
+
+        ranges.push_back(Range{0, 0, size});
+        while (!ranges.empty()) {
+            Range range = ranges.back();
+            ranges.pop_back();
+            if (range.begin == range.end)
+                continue;
+
+            const FrozenNode &node = nodes[range.node];
+            if (node.link & FrozenNode::LEAF) {
+                std::uint32_t cell = node.link & ~FrozenNode::LEAF;
+                for (std::size_t i = range.begin; i < range.end; ++i) {
+                    std::size_t k = packet.index[i];
+                    FilteredPoint fp(packet.x[i], packet.y[i], packet.z[i]);
+                    packet_ids[k] = contains(cell, packet_points[k], fp, counters) ? cell_ids[cell] : -1;
+                }
+                continue;
+            }
+
+            std::uint32_t plane = node.plane;
+            const FilteredPlane &fplane = fplanes[plane];
+            for (std::size_t i = range.begin; i < range.end; ++i)
+                packet.side[i] = fplane.certain_side(packet.x[i], packet.y[i], packet.z[i]);
+
+            for (std::size_t i = range.begin; i < range.end; ++i) {
+                if (packet.side[i])
+                    continue;
+
+                std::size_t k = packet.index[i];
+                switch (exact_side(owned.planes, plane_offsets, plane, packet_points[k])) {
+                    case CGAL::ON_POSITIVE_SIDE:
+                        packet.side[i] = 1;
+                        break;
+                    case CGAL::ON_NEGATIVE_SIDE:
+                        packet.side[i] = -1;
+                        break;
+                    case CGAL::ON_ORIENTED_BOUNDARY: {
+                        FilteredPoint fp(packet.x[i], packet.y[i], packet.z[i]);
+                        packet_ids[k] = -1;
+                        for (std::uint32_t j = boundary_begin[plane]; j < boundary_begin[plane + 1]; ++j) {
+                            if (contains(boundary[j], packet_points[k], fp, counters)) {
+                                packet_ids[k] = cell_ids[boundary[j]];
+                                break;
+                            }
+                        }
+                        packet.side[i] = 2;
+                    }
+                }
+            }
+
+            std::size_t last = range.end;
+            for (std::size_t i = range.begin; i < last; ) {
+                if (packet.side[i] == 2)
+                    packet.swap(i, --last);
+                else ++i;
+            }
+
+            std::size_t mid = range.begin;
+            for (std::size_t i = range.begin; i < last; ++i) {
+                if (packet.side[i] < 0)
+                    packet.swap(i, mid++);
+            }
+
+            ranges.push_back(Range{node.link + 1, mid, last});
+            ranges.push_back(Range{node.link, range.begin, mid});
+        }
+    }
+}
+
+template <class Kernel>
+void BasicFrozenBSPTree<Kernel>::locate_batch(const Point_3 *points, std::size_t n, int *ids, unsigned threads) const {
+    parallel_for(n, 16 * PACKET_SIZE, threads, [&](std::size_t begin, std::size_t end) {
+        locate_batch(points + begin, end - begin, ids + begin);
+    });
+}
+
+template <class Kernel>
+std::size_t BasicFrozenBSPTree<Kernel>::size() const {
+    return cell_ids.size;
+}
+
+template <class Kernel>
+bool BasicFrozenBSPTree<Kernel>::empty() const {
+    return !nodes.size;
+}
+
+// CLASS BasicSnapshotBSPTree
+
+// Node of a BasicSnapshotBSPTree, shared by every version reaching it.
+// Leaves have no children and internal nodes no cell.
+template <class Kernel>
+struct SnapshotNode {
+    typedef std::shared_ptr<const SnapshotNode> Ptr;
+    typedef std::shared_ptr<const Cell<Kernel> > CellPtr;
+
+    Ptr left, right;
+    typename Kernel::Plane_3 plane;
+    FilteredPlane fplane;
+    // cells touching or crossing the plane
+    std::vector<CellPtr> polys;
+    CellPtr cell;
+
+    bool has_children() const {
+        return bool(left);
+    }
+};
+
+template <class Kernel>
+std::shared_ptr<const SnapshotNode<Kernel> > snapshot_leaf(const std::shared_ptr<const Cell<Kernel> > &cell) {
+    std::shared_ptr<SnapshotNode<Kernel> > node = std::make_shared<SnapshotNode<Kernel> >();
+    node->cell = cell;
+    return node;
+}
+
+template <class Kernel>
+std::shared_ptr<const SnapshotNode<Kernel> > snapshot_internal(const typename Kernel::Plane_3 &plane,
+        const std::shared_ptr<const SnapshotNode<Kernel> > &left, const std::shared_ptr<const SnapshotNode<Kernel> > &right,
+        std::vector<std::shared_ptr<const Cell<Kernel> > > polys) {
+    std::shared_ptr<SnapshotNode<Kernel> > node = std::make_shared<SnapshotNode<Kernel> >();
+    node->left = left;
+    node->right = right;
+    node->plane = plane;
+    node->fplane = FilteredPlane(plane);
+    node->polys.swap(polys);
+    cache_exact(node->plane);
+    return node;
+}
+
+// Copies the nodes of a tree built by BasicBSPTree, sharing one cell
+// between all leaves holding it.
+template <class Kernel>
+std::shared_ptr<const SnapshotNode<Kernel> > snapshot_copy(Node<Kernel> *node,
+        std::unordered_map<Index, std::shared_ptr<const Cell<Kernel> > > &cells) {
+    if (!node->has_children())
+        return snapshot_leaf<Kernel>(cells.at(static_cast<LeafNode<Kernel>*>(node)->cell));
+
+    InternalNode<Kernel> *inode = static_cast<InternalNode<Kernel>*>(node);
+    std::vector<std::shared_ptr<const Cell<Kernel> > > polys;
+    for (Index cell : inode->polys)
+        polys.push_back(cells.at(cell));
+    return snapshot_internal<Kernel>(inode->plane, snapshot_copy(inode->left, cells),
+            snapshot_copy(inode->right, cells), polys);
+}
+
+// Returns a copy of the subtree with the cell inserted as ::insert() would,
+// sharing every node the cell does not reach.
+template <class Kernel>
+std::shared_ptr<const SnapshotNode<Kernel> > snapshot_insert(const std::shared_ptr<const SnapshotNode<Kernel> > &node,
+        const std::shared_ptr<const Cell<Kernel> > &cell) {
+    typedef std::shared_ptr<const Cell<Kernel> > CellPtr;
+
+    if (!node->has_children()) {
+        const CellPtr &old = node->cell;
+        std::size_t i;
+        int side = separating_halfspace(*old, *cell, i);
+        if (side) {
+            std::vector<CellPtr> polys = { old };
+            if (side & ON_ORIENTED_BOUNDARY)
+                polys.push_back(cell);
+            if (side & ON_NEGATIVE_SIDE)
+                return snapshot_internal<Kernel>(old->halfspaces[i], snapshot_leaf<Kernel>(cell), node, polys);
+            return snapshot_internal<Kernel>(old->halfspaces[i], node, snapshot_leaf<Kernel>(cell), polys);
+        }
+
+        side = separating_halfspace(*cell, *old, i);
+        if (side) {
+            std::vector<CellPtr> polys = { cell };
+            if (side & ON_ORIENTED_BOUNDARY)
+                polys.push_back(old);
+            if (side & ON_NEGATIVE_SIDE)
+                return snapshot_internal<Kernel>(cell->halfspaces[i], node, snapshot_leaf<Kernel>(cell), polys);
+            return snapshot_internal<Kernel>(cell->halfspaces[i], snapshot_leaf<Kernel>(cell), node, polys);
+        }
+
+        throw std::runtime_error("Intersecting polyhedrons!");
+    }
+
+    int side = oriented_side(node->plane, node->fplane, *cell),
+        l = side & ON_NEGATIVE_SIDE,
+        r = side & ON_POSITIVE_SIDE;
+
+    std::shared_ptr<SnapshotNode<Kernel> > copy = std::make_shared<SnapshotNode<Kernel> >(*node);
+    if (on_boundary(side))
+        copy->polys.push_back(cell);
+    if (l)
+        copy->left = snapshot_insert(node->left, cell);
+    if (r || !l)
+        copy->right = snapshot_insert(node->right, cell);
+    return copy;
+}
+
+// Returns a copy of the subtree without the cell, or NULL if nothing is left
+// of it, sharing every node the cell does not reach. Sets found if a leaf
+// held the cell.
+template <class Kernel>
+std::shared_ptr<const SnapshotNode<Kernel> > snapshot_remove(const std::shared_ptr<const SnapshotNode<Kernel> > &node,
+        const std::shared_ptr<const Cell<Kernel> > &cell, bool &found) {
+    typedef std::shared_ptr<const SnapshotNode<Kernel> > NodePtr;
+
+    if (!node->has_children()) {
+        if (node->cell != cell)
+            return node;
+        found = true;
+        return NodePtr();
+    }
+
+    int side = oriented_side(node->plane, node->fplane, *cell),
+        l = side & ON_NEGATIVE_SIDE,
+        r = side & ON_POSITIVE_SIDE;
+
+    NodePtr left = l ? snapshot_remove(node->left, cell, found) : node->left,
+        right = r || !l ? snapshot_remove(node->right, cell, found) : node->right;
+    if (left == node->left && right == node->right)
+        return node;
+    if (!left || !right)
+        return left ? left : right;
+
+    std::shared_ptr<SnapshotNode<Kernel> > copy = std::make_shared<SnapshotNode<Kernel> >(*node);
+    copy->left = left;
+    copy->right = right;
+    copy->polys.erase(std::remove(copy->polys.begin(), copy->polys.end(), cell), copy->polys.end());
+    return copy;
+}
+
+template <class Kernel>
+BasicSnapshotBSPTree<Kernel>::Snapshot::Snapshot(const NodePtr &_root, std::size_t size, std::uint64_t version)
+    : root(_root), _size(size), _version(version) {}
+
+template <class Kernel>
+const typename BasicSnapshotBSPTree<Kernel>::Polyhedron_3*
+BasicSnapshotBSPTree<Kernel>::Snapshot::locate(const Point_3 &p) const {
+    if (!root)
+        return NULL;
+
+    FilteredPoint fp(p);
+    const SnapshotNode<Kernel> *node = root.get();
+    while (node->has_children()) {
+        switch (oriented_side(node->fplane, node->plane, fp, p)) {
+            case CGAL::ON_POSITIVE_SIDE:
+                node = node->right.get();
+                break;
+            case CGAL::ON_NEGATIVE_SIDE:
+                node = node->left.get();
+                break;
+            case CGAL::ON_ORIENTED_BOUNDARY:
+                for (const CellPtr &cell : node->polys) {
+                    if (cell->contains(p, fp))
+                        return &cell->poly;
+                }
+                return NULL;
+        }
+    }
+
+    if (node->cell->contains(p, fp))
+        return &node->cell->poly;
+    return NULL;
 }
+
+template <class Kernel>
+std::size_t BasicSnapshotBSPTree<Kernel>::Snapshot::size() const {
+    return _size;
+}
+
+template <class Kernel>
+bool BasicSnapshotBSPTree<Kernel>::Snapshot::empty() const {
+    return !root;
+}
+
+template <class Kernel>
+std::uint64_t BasicSnapshotBSPTree<Kernel>::Snapshot::version() const {
+    return _version;
+}
+
+template <class Kernel>
+BasicSnapshotBSPTree<Kernel>::BasicSnapshotBSPTree()
+    : current(std::make_shared<const Snapshot>(NodePtr(), 0, 0)) {}
+
+template <class Kernel>
+BasicSnapshotBSPTree<Kernel>::BasicSnapshotBSPTree(const std::vector<Polyhedron_3> &v, const BuildOptions &options) {
+    BasicBSPTree<Kernel> tree(v, options);
+
+    std::unordered_map<Index, CellPtr> cells;
+    for (const Polyhedron_3 &poly : v) {
+        Index cell = tree.store.find(poly.id());
+        if (cell != BasicBSPTree<Kernel>::Cells::NONE && !cells.count(cell)) {
+            cells[cell] = std::make_shared<const Cell<Kernel> >(tree.store.cell(cell));
+            ids[poly.id()] = cells[cell];
+        }
+    }
+
+    NodePtr root;
+    if (tree.root)
+        root = snapshot_copy(tree.root, cells);
+    current = std::make_shared<const Snapshot>(root, ids.size(), 0);
+}
+
+template <class Kernel>
+std::shared_ptr<const typename BasicSnapshotBSPTree<Kernel>::Snapshot> BasicSnapshotBSPTree<Kernel>::snapshot() const {
+    return std::atomic_load(&current);
+}
+
+template <class Kernel>
+void BasicSnapshotBSPTree<Kernel>::publish(const NodePtr &root) {
+    // only the writer replaces current, so it may read it plainly
+    std::atomic_store(&current, std::shared_ptr<const Snapshot>(
+                std::make_shared<const Snapshot>(root, ids.size(), current->version() + 1)));
+}
+
+template <class Kernel>
+bool BasicSnapshotBSPTree<Kernel>::insert(const Polyhedron_3 &poly) {
+    std::lock_guard<std::mutex> lock(writer);
+    if (!poly.is_valid() || ids.count(poly.id()))
+        return false;
+
+    CellPtr cell = std::make_shared<const Cell<Kernel> >(Polyhedron_3(poly));
+    NodePtr root = current->root;
+    root = root ? snapshot_insert(root, cell) : snapshot_leaf<Kernel>(cell);
+
+    ids[poly.id()] = cell;
+    publish(root);
+    return true;
+}
+
+template <class Kernel>
+bool BasicSnapshotBSPTree<Kernel>::remove(const Polyhedron_3 &poly) {
+    std::lock_guard<std::mutex> lock(writer);
+    auto it = ids.find(poly.id());
+    if (it == ids.end())
+        return false;
+
+    bool found = false;
+    NodePtr root = snapshot_remove(current->root, it->second, found);
+    if (!found)
+        return false;
+
+    ids.erase(it);
+    publish(root);
+    return true;
+}
+
+// EXPLICIT INSTANTIATIONS
+
+#define BSP_INSTANTIATE(KERNEL) \
+    template class BasicPolyhedron_3<KERNEL>; \
+    template struct Cell<KERNEL>; \
+    template class CellStore<KERNEL>; \
+    template class BasicBSPTree<KERNEL>; \
+    template class BasicFrozenBSPTree<KERNEL>; \
+    template class BasicSnapshotBSPTree<KERNEL>; \
+    template std::ostream& operator<< <KERNEL>(std::ostream&, const BasicBSPTree<KERNEL>&); \
+    template bool point_in_polyhedron<KERNEL>(const BasicPolyhedron_3<KERNEL>&, const KERNEL::Point_3&);
+
+BSP_INSTANTIATE(Gmpq_kernel)
+BSP_INSTANTIATE(Epick)
+BSP_INSTANTIATE(Epeck)
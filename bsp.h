@@ -1,18 +1,36 @@
 #ifndef BSP_H
 #define BSP_H
 
+#include <atomic>
+#include <cmath>
+#include <cstdint>
 #include <ostream>
+#include <string>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <initializer_list>
 
 #include <CGAL/Gmpq.h>
 #include <CGAL/Simple_cartesian.h>
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
+#include <CGAL/Exact_predicates_exact_constructions_kernel.h>
 #include <CGAL/Polyhedron_3.h>
 
-class Node;
+#include "mapped_file.h"
 
-typedef CGAL::Simple_cartesian<CGAL::Gmpq> K;
-typedef K::Point_3 Point_3;
-typedef K::Plane_3 Plane_3;
-typedef CGAL::Polyhedron_3<K> CGALPolyhedron_3;
+template <class Kernel> class Node;
+template <class Kernel> class NodePool;
+template <class Kernel> struct SnapshotNode;
+
+// Kernels the tree is instantiated for in bsp.cpp.
+typedef CGAL::Simple_cartesian<CGAL::Gmpq> Gmpq_kernel;
+typedef CGAL::Exact_predicates_inexact_constructions_kernel Epick;
+typedef CGAL::Exact_predicates_exact_constructions_kernel Epeck;
 
 struct Plane_equation {
     template <class Facet>
@@ -25,47 +43,611 @@ struct Plane_equation {
     }
 };
 
-class Polyhedron_3 : public CGAL::Polyhedron_3<K> {
+template <class Kernel>
+class BasicPolyhedron_3 : public CGAL::Polyhedron_3<Kernel> {
     int _id;
-    static int _max_id;
+    // atomic, so cells may be created on several threads
+    static std::atomic<int> _max_id;
 
     public:
 
-        Polyhedron_3();
-        Polyhedron_3(const CGALPolyhedron_3&);
+        typedef CGAL::Polyhedron_3<Kernel> CGALPolyhedron_3;
+
+        BasicPolyhedron_3();
+        BasicPolyhedron_3(const CGALPolyhedron_3&);
 
-        bool operator==(const Polyhedron_3&) const;
-        bool operator<(const Polyhedron_3&) const;
+        bool operator==(const BasicPolyhedron_3&) const;
+        bool operator<(const BasicPolyhedron_3&) const;
 
         int id() const;
 };
 
-class BSPTree {
-    Node *root;
+// Double-precision mirrors of exact points and planes. The sign of
+// a*x + b*y + c*z + d evaluated in doubles is trusted only when it exceeds
+// the accumulated rounding error of the conversions and of the evaluation
+// itself; otherwise the exact predicate decides.
+
+struct FilteredPoint {
+    double x, y, z;
+
+    template <class Point>
+    FilteredPoint(const Point &p)
+        : x(CGAL::to_double(p.x())), y(CGAL::to_double(p.y())), z(CGAL::to_double(p.z())) {}
+
+    FilteredPoint(double _x, double _y, double _z)
+        : x(_x), y(_y), z(_z) {}
+};
+
+struct FilteredPlane {
+    // 8 ulps for the conversions, products and sums plus a safety margin
+    static constexpr double EPS = 1e-15;
+    // below this magnitude denormals make the relative bound meaningless
+    static constexpr double MIN_MAGNITUDE = 1e-280;
+
+    double a, b, c, d;
+
+    FilteredPlane() : a(0), b(0), c(0), d(0) {}
+
+    template <class Plane>
+    FilteredPlane(const Plane &plane)
+        : a(CGAL::to_double(plane.a())), b(CGAL::to_double(plane.b())),
+          c(CGAL::to_double(plane.c())), d(CGAL::to_double(plane.d())) {}
+
+    // Returns -1 or 1 for a certified side and 0 if the exact predicate has
+    // to decide. Branch-free, so loops over coordinate arrays vectorise.
+    int certain_side(double x, double y, double z) const {
+        double ax = a * x, by = b * y, cz = c * z,
+               value = ax + by + cz + d,
+               magnitude = std::fabs(ax) + std::fabs(by) + std::fabs(cz) + std::fabs(d),
+               bound = EPS * magnitude;
+
+        // written so that NaN and infinity fall through to the exact path
+        int valid = magnitude > MIN_MAGNITUDE;
+        return valid * ((value > bound) - (value < -bound));
+    }
+
+    // Returns false if the sign cannot be certified in floating point.
+    bool oriented_side(const FilteredPoint &p, CGAL::Oriented_side &side) const {
+        int sign = certain_side(p.x, p.y, p.z);
+        if (!sign)
+            return false;
+
+        side = sign > 0 ? CGAL::ON_POSITIVE_SIDE : CGAL::ON_NEGATIVE_SIDE;
+        return true;
+    }
+};
+
+// A polyhedron together with its facet planes oriented so that the interior
+// lies on their negative sides, computed once when the cell is stored.
+template <class Kernel>
+struct Cell {
+    typedef typename Kernel::Point_3 Point_3;
+    typedef typename Kernel::Plane_3 Plane_3;
+    typedef BasicPolyhedron_3<Kernel> Polyhedron_3;
+
+    Polyhedron_3 poly;
+    std::vector<Plane_3> halfspaces;
+    std::vector<FilteredPlane> fhalfspaces;
+    // vertices in the order of poly.points_begin()
+    std::vector<FilteredPoint> fvertices;
+    // approximate, for split heuristics and statistics
+    double volume;
+    // bounding box of fvertices; rounding is monotone, so cells touching in
+    // exact arithmetic have touching boxes
+    double lo[3], hi[3];
+
+    Cell(Polyhedron_3&&);
+
+    // Points on the boundary are contained.
+    bool contains(const Point_3&, const FilteredPoint&) const;
+    // Whether the bounding boxes meet.
+    bool overlaps(const Cell&) const;
+};
+
+// A cell sharing a facet with another one, whose half-space `halfspace`
+// holds the shared facet.
+struct Neighbour {
+    std::size_t cell;
+    std::size_t halfspace;
+};
+
+// Owns the polyhedra referenced by a tree. Every polyhedron is stored once
+// and nodes refer to it by index, so building, splitting and inserting
+// only ever move indices around. Slots of erased cells are reused.
+template <class Kernel>
+class CellStore {
+    public:
+
+        typedef BasicPolyhedron_3<Kernel> Polyhedron_3;
+        typedef std::size_t Index;
+
+        static const Index NONE = Index(-1);
+
+    private:
+
+        // a deque never relocates its elements, so growing the store does
+        // not copy meshes
+        std::deque<Cell<Kernel> > cells;
+        std::vector<Index> free_slots;
+        std::unordered_map<int, Index> indices;
+        // by cell index, empty for cells not connected yet
+        std::vector<std::vector<Neighbour> > neighbour_lists;
+
+        void link(Index, Index);
+
+    public:
+
+        Index add(const Polyhedron_3&);
+        Index add(Polyhedron_3&&);
+        // Also drops the cell from the neighbour lists of other cells.
+        void erase(Index);
+
+        // Finds the cells sharing a facet with the given, newly added ones:
+        // cells with overlapping bounding boxes and opposite facet planes,
+        // searched for through the boxes of the nodes of the tree holding
+        // all of them.
+        void connect(const std::vector<Index>&, const Node<Kernel>*);
+        const std::vector<Neighbour>& neighbours(Index) const;
+
+        // Index of the polyhedron with the given id, or NONE.
+        Index find(int) const;
+
+        const Polyhedron_3& operator[](Index) const;
+        const Cell<Kernel>& cell(Index) const;
+
+        std::size_t size() const;
+        void clear();
+};
+
+// How create_node() chooses a splitting plane among the facet planes of
+// the cells it is given.
+enum SplitHeuristic {
+    // the first plane dividing the cells, in input order
+    SPLIT_FIRST,
+    // minimise balance_weight * |left - right| + straddle_weight * straddling
+    SPLIT_BALANCE,
+    // minimise the number of cells cut by the plane, then the imbalance
+    SPLIT_MIN_STRADDLE,
+    // minimise the expected number of cells below the node for a uniformly
+    // distributed query point, estimated from cell volumes
+    SPLIT_SAH,
+};
+
+struct BuildOptions {
+    SplitHeuristic heuristic;
+    double balance_weight;
+    // cells cut by the plane are copied into both subtrees
+    double straddle_weight;
+    // SAH cost of descending one level, in units of one containment test
+    double traversal_cost;
+    // planes sampled per node, 0 evaluates every facet plane
+    std::size_t max_candidates;
+    std::uint64_t seed;
+    // 0 means one per core; the tree does not depend on it
+    unsigned threads;
+    // insert() and remove() rebuild a subtree whose heavier child holds more
+    // than this fraction of its leaves, once the subtree has seen updates
+    // amounting to half its leaves; 1 or more turns rebalancing off
+    double rebalance_alpha;
+
+    BuildOptions()
+        : heuristic(SPLIT_BALANCE), balance_weight(1), straddle_weight(2),
+          traversal_cost(1), max_candidates(64), seed(0), threads(0),
+          rebalance_alpha(0.75) {}
+};
+
+struct TreeStats {
+    std::size_t nodes;
+    std::size_t leaves;
+    std::size_t max_depth;
+    // mean depth of the leaves
+    double average_depth;
+    // mean depth of the leaves weighted by the volume of their cells, i.e.
+    // the expected path length of a uniformly distributed query point
+    double expected_depth;
+    // sizes of the boundary lists of the internal nodes, which a query
+    // landing on a plane scans
+    std::size_t boundary_total, boundary_max;
+    double boundary_average;
+    // bytes held by the nodes and their boundary lists, and by the cells
+    // with their meshes; estimates that leave out allocator overhead and
+    // the heap storage of exact numbers
+    std::size_t node_bytes, cell_bytes;
+};
+
+// Work done by the locate() calls given the same QueryStats, summed over
+// the calls. Calls without one count nothing and cost nothing extra.
+struct QueryStats {
+    std::size_t queries;
+    // splitting planes the points were tested against
+    std::size_t planes;
+    // side tests the floating-point filter could not decide, which fell
+    // back to exact arithmetic
+    std::size_t exact;
+    // cells tested for containing the point
+    std::size_t containment;
+    // queries given a hint, and those answered by the hint itself or by
+    // walking from it to neighbouring cells
+    std::size_t hinted, hint_hits, walk_hits;
+
+    QueryStats()
+        : queries(0), planes(0), exact(0), containment(0),
+          hinted(0), hint_hits(0), walk_hits(0) {}
+};
+
+// Queries (the const member functions) never write to the tree or to CGAL
+// objects shared with it, so any number of threads may run them
+// concurrently as long as no thread modifies the tree at the same time.
+template <class Kernel>
+class BasicBSPTree {
+    public:
+
+        typedef typename Kernel::FT FT;
+        typedef typename Kernel::Point_3 Point_3;
+        typedef typename Kernel::Plane_3 Plane_3;
+        typedef typename Kernel::Ray_3 Ray_3;
+        typedef typename Kernel::Segment_3 Segment_3;
+        typedef typename Kernel::Iso_cuboid_3 Iso_cuboid_3;
+        typedef BasicPolyhedron_3<Kernel> Polyhedron_3;
+        typedef CellStore<Kernel> Cells;
+
+        // A polyhedron met by a ray or segment, entered at source + enter * v
+        // and left at source + exit * v, where v is the direction of the ray
+        // or target - source for a segment.
+        struct Hit {
+            const Polyhedron_3 *poly;
+            FT enter, exit;
+        };
+
+        // A polyhedron and its distance from a query point, in floating
+        // point; 0 if the polyhedron contains the point.
+        struct Near {
+            const Polyhedron_3 *poly;
+            double distance;
+        };
+
+    private:
+
+        Cells store;
+        BuildOptions options;
+        // nodes are allocated from the pool, which keeps their memory
+        // across clear() and rebuild()
+        std::unique_ptr<NodePool<Kernel> > pool;
+        Node<Kernel> *root;
+
+        void range_ids(const Iso_cuboid_3&, const std::function<void(int)>&) const;
+        void range_ids(const Plane_3&, const std::function<void(int)>&) const;
 
     public:
 
-        BSPTree();
-        BSPTree(std::initializer_list<Polyhedron_3>);
-        BSPTree(const std::vector<Polyhedron_3>&);
+        // Every polyhedron is copied exactly once, into the cell store; pass
+        // an rvalue to move it in instead.
+        BasicBSPTree(const BuildOptions& = BuildOptions());
+        BasicBSPTree(std::initializer_list<Polyhedron_3>, const BuildOptions& = BuildOptions());
+        BasicBSPTree(const std::vector<Polyhedron_3>&, const BuildOptions& = BuildOptions());
+        BasicBSPTree(std::vector<Polyhedron_3>&&, const BuildOptions& = BuildOptions());
+
+        BasicBSPTree(const BasicBSPTree&) = delete;
+        BasicBSPTree(BasicBSPTree&&);
+        BasicBSPTree& operator=(BasicBSPTree&&);
+        BasicBSPTree& operator=(const BasicBSPTree&) = delete;
 
-        BSPTree(const BSPTree&) = delete;
-        BSPTree(BSPTree&&);
-        BSPTree& operator=(BSPTree&&);
-        BSPTree& operator=(const BSPTree&) = delete;
+        ~BasicBSPTree();
 
-        ~BSPTree();
+        // Replaces the contents of the tree, reusing its nodes. The tree is
+        // left empty if building fails.
+        void rebuild(const std::vector<Polyhedron_3>&, const BuildOptions&);
+        void rebuild(std::vector<Polyhedron_3>&&, const BuildOptions&);
 
+        // Returns the polyhedron containing the point, or NULL. The pointer
+        // stays valid until the polyhedron is removed or the tree cleared.
+        const Polyhedron_3* locate(const Point_3&) const;
         bool locate(const Point_3&, Polyhedron_3&) const;
+        // The same, adding the work done to the statistics.
+        const Polyhedron_3* locate(const Point_3&, QueryStats&) const;
+        // The same, for a point near one located before: the polyhedron
+        // returned for that point, the hint, is tested first, then a few
+        // steps are taken across facets towards the point before descending
+        // from the root. Any polyhedron containing a point on a shared
+        // facet may be returned. The hint may be NULL.
+        const Polyhedron_3* locate(const Point_3&, const Polyhedron_3*) const;
+        const Polyhedron_3* locate(const Point_3&, const Polyhedron_3*, QueryStats&) const;
+        // Locates n points at once, writing the id of the containing
+        // polyhedron, or -1, to ids[i]. Points travel down the tree in
+        // packets, so every node is loaded once per packet.
+        void locate_batch(const Point_3*, std::size_t, int*) const;
+        // The same, spread over the given number of threads (0 means one
+        // per core).
+        void locate_batch(const Point_3*, std::size_t, int*, unsigned) const;
+        // Polyhedra met by the ray or segment, front to back. The leaves are
+        // visited in the order the line crosses their regions, splitting its
+        // parameter interval at every plane on the way; polyhedra touched in
+        // a single point are met too.
+        std::vector<Hit> trace(const Ray_3&) const;
+        std::vector<Hit> trace(const Segment_3&) const;
+        // The first of them, found without visiting the leaves behind it.
+        bool first_hit(const Ray_3&, Hit&) const;
+        bool first_hit(const Segment_3&, Hit&) const;
+        // Write the id of the first polyhedron met by ray or segment i, or
+        // -1, to ids[i], optionally spread over the given number of threads
+        // (0 means one per core).
+        void first_hit_batch(const Ray_3*, std::size_t, int*) const;
+        void first_hit_batch(const Ray_3*, std::size_t, int*, unsigned) const;
+        void first_hit_batch(const Segment_3*, std::size_t, int*) const;
+        void first_hit_batch(const Segment_3*, std::size_t, int*, unsigned) const;
+        // Write the ids of the polyhedra meeting the closed box, or the
+        // closed negative side of the plane, to the output iterator, each
+        // once. Subtrees on the other side of a splitting plane than the
+        // whole region are skipped, so only cells near the region are tested.
+        // The plane must not be degenerate.
+        template <class OutputIterator>
+        OutputIterator range(const Iso_cuboid_3&, OutputIterator) const;
+        template <class OutputIterator>
+        OutputIterator range(const Plane_3&, OutputIterator) const;
+        // The polyhedron nearest to the point, for points that locate()
+        // finds in none. Subtrees are visited nearest first and skipped once
+        // their bounding boxes, or the splitting planes in front of them, lie
+        // further away than the polyhedron found, so only cells near the
+        // point are measured. Returns false if no polyhedron lies within
+        // max_distance.
+        bool nearest(const Point_3&, Near&,
+                double max_distance = std::numeric_limits<double>::infinity()) const;
+        // The k nearest polyhedra within max_distance, nearest first.
+        std::vector<Near> nearest(const Point_3&, std::size_t k,
+                double max_distance = std::numeric_limits<double>::infinity()) const;
         bool insert(const Polyhedron_3&);
+        bool insert(Polyhedron_3&&);
         bool remove(const Polyhedron_3&);
+        // Insert or remove many polyhedra at once, classifying the whole
+        // batch against each plane on the way down once. Leaves reached by
+        // new cells are replaced by subtrees from the bulk builder, and
+        // subtrees emptied by a removal collapse in the same pass. Return
+        // the number of polyhedra inserted or removed; a failed insert
+        // leaves the tree unchanged.
+        std::size_t insert(const std::vector<Polyhedron_3>&);
+        std::size_t insert(std::vector<Polyhedron_3>&&);
+        std::size_t remove(const std::vector<Polyhedron_3>&);
+
+        const Cells& cells() const;
+        TreeStats stats() const;
 
         bool empty() const;
         void clear();
 
-        friend std::ostream& operator<<(std::ostream&, const BSPTree&);
+        template <class K_>
+        friend std::ostream& operator<<(std::ostream&, const BasicBSPTree<K_>&);
+        template <class K_>
+        friend class BasicFrozenBSPTree;
+        template <class K_>
+        friend class BasicSnapshotBSPTree;
 };
 
-bool point_in_polyhedron(const Polyhedron_3&, const Point_3&);
+template <class Kernel>
+template <class OutputIterator>
+OutputIterator BasicBSPTree<Kernel>::range(const Iso_cuboid_3 &box, OutputIterator out) const {
+    range_ids(box, [&out](int id) {
+        *out++ = id;
+    });
+    return out;
+}
+
+template <class Kernel>
+template <class OutputIterator>
+OutputIterator BasicBSPTree<Kernel>::range(const Plane_3 &plane, OutputIterator out) const {
+    range_ids(plane, [&out](int id) {
+        *out++ = id;
+    });
+    return out;
+}
+
+struct FrozenNode {
+    static const std::uint32_t LEAF = std::uint32_t(1) << 31;
+
+    // internal nodes: index of the left child, the right child follows it
+    // leaves: LEAF | index of the cell
+    std::uint32_t link;
+    // internal nodes: index of the plane and of the boundary list
+    std::uint32_t plane;
+};
+
+// A read-only copy of a built tree laid out for queries. Nodes live in one
+// array in breadth-first order, both children of a node next to each
+// other; planes, boundary lists and cell half-spaces live in side arrays
+// indexed by the nodes. Only the half-spaces and ids of the cells are kept,
+// so the frozen tree does not depend on the tree it was made from.
+//
+// save() writes the arrays to a versioned binary file and load() maps such
+// a file and queries it in place. Exact coefficients are then decoded only
+// when the floating-point filter cannot decide a side, so loading costs
+// the same whatever the size of the tree.
+template <class Kernel>
+class BasicFrozenBSPTree {
+    public:
+
+        typedef typename Kernel::FT FT;
+        typedef typename Kernel::Point_3 Point_3;
+        typedef typename Kernel::Plane_3 Plane_3;
+
+    private:
+
+        // An array owned by this object or lying in the mapped file.
+        template <class T>
+        struct View {
+            const T *data;
+            std::size_t size;
+
+            View() : data(NULL), size(0) {}
+            View(const std::vector<T> &v) : data(v.data()), size(v.size()) {}
+            View(const T *_data, std::size_t _size) : data(_data), size(_size) {}
+
+            const T& operator[](std::size_t i) const {
+                return data[i];
+            }
+        };
+
+        // arrays of a tree frozen in this process
+        struct Storage {
+            std::vector<FrozenNode> nodes;
+            std::vector<Plane_3> planes;
+            std::vector<FilteredPlane> fplanes;
+            std::vector<std::uint32_t> boundary_begin, boundary;
+            std::vector<std::uint32_t> cell_begin;
+            std::vector<Plane_3> halfspaces;
+            std::vector<FilteredPlane> fhalfspaces;
+            std::vector<int> cell_ids;
+        };
+
+        Storage owned;
+        MappedFile file;
+
+        View<FrozenNode> nodes;
+        View<FilteredPlane> fplanes;
+        // boundary list of plane i is boundary[boundary_begin[i] .. boundary_begin[i + 1])
+        View<std::uint32_t> boundary_begin, boundary;
+        // half-spaces of cell i are fhalfspaces[cell_begin[i] .. cell_begin[i + 1])
+        View<std::uint32_t> cell_begin;
+        View<FilteredPlane> fhalfspaces;
+        View<int> cell_ids;
+        // exact coefficients of plane i in a mapped file start at
+        // exact + plane_offsets[i]; likewise for the half-spaces
+        View<std::uint64_t> plane_offsets, halfspace_offsets;
+        const char *exact;
+
+        void bind();
+        // Whether the arrays of a loaded file are consistent, given the size
+        // of its exact section.
+        bool valid(std::size_t) const;
+        CGAL::Oriented_side exact_side(const std::vector<Plane_3>&, const View<std::uint64_t>&, std::uint32_t,
+                const Point_3&) const;
+        template <class Counters>
+        CGAL::Oriented_side plane_side(std::uint32_t, const Point_3&, const FilteredPoint&, Counters&) const;
+        template <class Counters>
+        bool contains(std::uint32_t, const Point_3&, const FilteredPoint&, Counters&) const;
+        template <class Counters>
+        int find(const Point_3&, Counters&) const;
+
+    public:
+
+        BasicFrozenBSPTree();
+        explicit BasicFrozenBSPTree(const BasicBSPTree<Kernel>&);
+
+        BasicFrozenBSPTree(const BasicFrozenBSPTree&) = delete;
+        BasicFrozenBSPTree(BasicFrozenBSPTree&&) = default;
+        BasicFrozenBSPTree& operator=(const BasicFrozenBSPTree&) = delete;
+        BasicFrozenBSPTree& operator=(BasicFrozenBSPTree&&) = default;
+
+        // Throws std::runtime_error if the file cannot be written, or read
+        // back by this kernel and version.
+        void save(const std::string&) const;
+        static BasicFrozenBSPTree load(const std::string&);
+
+        // Returns the id of the polyhedron containing the point, or -1.
+        int locate(const Point_3&) const;
+        // The same, adding the work done to the statistics.
+        int locate(const Point_3&, QueryStats&) const;
+        // As BasicBSPTree::locate_batch().
+        void locate_batch(const Point_3*, std::size_t, int*) const;
+        void locate_batch(const Point_3*, std::size_t, int*, unsigned) const;
+
+        // Number of cells.
+        std::size_t size() const;
+        bool empty() const;
+};
+
+// A tree that keeps answering queries while it is updated. Nodes and cells
+// never change once published: insert() and remove() copy the path from the
+// root to the nodes they change, share the rest with the previous version
+// and publish the new version atomically. A reader pins the current version
+// with snapshot() and queries it for as long as it likes; a version, and the
+// nodes and cells no newer version shares, is freed with its last snapshot.
+// Updates are serialised among themselves and never wait for readers.
+template <class Kernel>
+class BasicSnapshotBSPTree {
+    public:
+
+        typedef typename Kernel::Point_3 Point_3;
+        typedef BasicPolyhedron_3<Kernel> Polyhedron_3;
+        typedef std::shared_ptr<const SnapshotNode<Kernel> > NodePtr;
+        typedef std::shared_ptr<const Cell<Kernel> > CellPtr;
+
+        // One version of the tree. Any number of threads may query it.
+        class Snapshot {
+            NodePtr root;
+            std::size_t _size;
+            std::uint64_t _version;
+
+            friend class BasicSnapshotBSPTree;
+
+            public:
+
+                Snapshot(const NodePtr&, std::size_t, std::uint64_t);
+
+                // As BasicBSPTree::locate(). The polyhedron lives as long as
+                // the snapshot.
+                const Polyhedron_3* locate(const Point_3&) const;
+
+                std::size_t size() const;
+                bool empty() const;
+                // Number of updates published before this version.
+                std::uint64_t version() const;
+        };
+
+    private:
+
+        // read and replaced with std::atomic_load() and std::atomic_store()
+        std::shared_ptr<const Snapshot> current;
+        std::mutex writer;
+        // cells of the current version by polyhedron id, for the writer
+        std::unordered_map<int, CellPtr> ids;
+
+        void publish(const NodePtr&);
+
+    public:
+
+        BasicSnapshotBSPTree();
+        // Builds the first version with the bulk builder.
+        explicit BasicSnapshotBSPTree(const std::vector<Polyhedron_3>&, const BuildOptions& = BuildOptions());
+
+        BasicSnapshotBSPTree(const BasicSnapshotBSPTree&) = delete;
+        BasicSnapshotBSPTree& operator=(const BasicSnapshotBSPTree&) = delete;
+
+        // The current version.
+        std::shared_ptr<const Snapshot> snapshot() const;
+
+        // Publish a new version unless they return false. Readers of older
+        // versions are not affected.
+        bool insert(const Polyhedron_3&);
+        bool remove(const Polyhedron_3&);
+};
+
+template <class Kernel>
+std::ostream& operator<<(std::ostream&, const BasicBSPTree<Kernel>&);
+
+template <class Kernel>
+bool point_in_polyhedron(const BasicPolyhedron_3<Kernel>&, const typename Kernel::Point_3&);
+
+#define BSP_EXTERN_TEMPLATES(KERNEL) \
+    extern template class BasicPolyhedron_3<KERNEL>; \
+    extern template struct Cell<KERNEL>; \
+    extern template class CellStore<KERNEL>; \
+    extern template class BasicBSPTree<KERNEL>; \
+    extern template class BasicFrozenBSPTree<KERNEL>; \
+    extern template class BasicSnapshotBSPTree<KERNEL>; \
+    extern template std::ostream& operator<< <KERNEL>(std::ostream&, const BasicBSPTree<KERNEL>&); \
+    extern template bool point_in_polyhedron<KERNEL>(const BasicPolyhedron_3<KERNEL>&, const KERNEL::Point_3&);
+
+BSP_EXTERN_TEMPLATES(Gmpq_kernel)
+BSP_EXTERN_TEMPLATES(Epick)
+BSP_EXTERN_TEMPLATES(Epeck)
+
+// Kernel used by the interactive program.
+typedef Gmpq_kernel K;
+typedef K::Point_3 Point_3;
+typedef K::Plane_3 Plane_3;
+typedef BasicPolyhedron_3<K> Polyhedron_3;
+typedef Polyhedron_3::CGALPolyhedron_3 CGALPolyhedron_3;
+typedef BasicBSPTree<K> BSPTree;
+typedef BasicFrozenBSPTree<K> FrozenBSPTree;
+typedef BasicSnapshotBSPTree<K> SnapshotBSPTree;
 
 #endif // BSP_H
@@ -0,0 +1,529 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/resource.h>
+
+#include "bsp.h"
+#include "cubes.h"
+#include "decomposition.h"
+#include "parallel.h"
+
+// Times building, locating, inserting and removing on the cube grid and on
+// every .off mesh of a directory. Every measurement is the best of a number
+// of repetitions; the threaded benchmarks are repeated for 1, 2, 4, ...
+// threads up to --threads. With --json the results are printed as one JSON array for
+// regression tracking, otherwise as a table.
+
+struct Options {
+    bool json;
+    unsigned repeat;
+    unsigned grid;
+    std::size_t queries;
+    // fraction of the cells removed and inserted again
+    double churn;
+    // most threads of the threaded benchmarks
+    unsigned threads;
+    std::string data;
+
+    Options() : json(false), repeat(5), grid(15), queries(100000), churn(0.1), threads(default_threads()), data("data") {}
+};
+
+struct Result {
+    std::string workload, benchmark;
+    unsigned threads;
+    // best time of one repetition
+    double seconds;
+    // operations per repetition
+    std::size_t ops;
+    // queries answered with a cell in the last repetition, 0 for updates;
+    // printed so that the query loops cannot be optimised away
+    std::size_t found;
+    TreeStats stats;
+    // peak resident set size of the process so far
+    long peak_kb;
+    // counters of one more repetition, for the hinted benchmark
+    QueryStats queries;
+};
+
+struct Workload {
+    std::string name;
+    std::vector<Polyhedron_3> cells;
+};
+
+void usage();
+Options parse(int, char**);
+std::vector<unsigned> thread_counts(unsigned);
+long peak_kb();
+double best_of(unsigned, const std::function<void()>&, const std::function<void()>& = std::function<void()>());
+std::vector<std::string> off_files(const std::string&);
+bool decomposition(const std::string&, std::vector<Polyhedron_3>&);
+void bounding_box(const std::vector<Polyhedron_3>&, double*, double*);
+std::vector<Point_3> query_points(const std::vector<Polyhedron_3>&, std::size_t);
+std::vector<Point_3> moving_points(const std::vector<Polyhedron_3>&, std::size_t, std::size_t);
+void run(const Workload&, const Options&, std::vector<Result>&);
+void print_table(const std::vector<Result>&);
+void print_json(const std::vector<Result>&);
+
+int main(int argc, char **argv) {
+    Options options;
+    try {
+        options = parse(argc, argv);
+    } catch (const std::runtime_error &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        usage();
+        return 1;
+    }
+
+    std::vector<Workload> workloads;
+    {
+        std::ostringstream name;
+        unsigned n = options.grid + 1;
+        name << "cubes " << n << "x" << n << "x" << n;
+        Workload w = { name.str(), std::vector<Polyhedron_3>() };
+        cubes(options.grid, options.grid, options.grid, w.cells);
+        workloads.push_back(w);
+    }
+    for (const std::string &filename : off_files(options.data)) {
+        Workload w = { filename, std::vector<Polyhedron_3>() };
+        if (decomposition(filename, w.cells))
+            workloads.push_back(w);
+    }
+
+    std::vector<Result> results;
+    for (const Workload &w : workloads) {
+        try {
+            run(w, options, results);
+        } catch (const std::runtime_error &e) {
+            std::cerr << w.name << ": " << e.what() << std::endl;
+        }
+    }
+
+    if (options.json)
+        print_json(results);
+    else print_table(results);
+}
+
+void usage() {
+    std::cerr << "Usage: bsp_bench [--json] [--repeat n] [--grid n] [--queries n] [--churn f] [--threads n] [data]" << std::endl
+        << "  --json - print the results as JSON" << std::endl
+        << "  --repeat n - repetitions of every measurement, the best counts (5)" << std::endl
+        << "  --grid n - the cube grid has (n + 1)^3 cells (15)" << std::endl
+        << "  --queries n - points located per repetition (100000)" << std::endl
+        << "  --churn f - fraction of the cells removed and inserted again (0.1)" << std::endl
+        << "  -t, --threads n - threaded benchmarks run on 1, 2, 4, ... up to n threads (one per core)" << std::endl
+        << "  data - directory of .off meshes (data)" << std::endl;
+}
+
+Options parse(int argc, char **argv) {
+    Options options;
+    bool data = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            usage();
+            std::exit(0);
+        }
+        if (arg == "--json") {
+            options.json = true;
+            continue;
+        }
+        if (arg[0] != '-') {
+            if (data)
+                throw std::runtime_error("More than one data directory!");
+            options.data = arg;
+            data = true;
+            continue;
+        }
+
+        if (i + 1 == argc)
+            throw std::runtime_error("Missing value of " + arg + "!");
+        std::istringstream value(argv[++i]);
+        if (arg == "--repeat")
+            value >> options.repeat;
+        else if (arg == "--grid")
+            value >> options.grid;
+        else if (arg == "--queries")
+            value >> options.queries;
+        else if (arg == "--churn")
+            value >> options.churn;
+        else if (arg == "-t" || arg == "--threads")
+            value >> options.threads;
+        else throw std::runtime_error("Unknown option " + arg + "!");
+
+        if (!value || !value.eof())
+            throw std::runtime_error("Invalid value of " + arg + "!");
+    }
+    if (!options.repeat || !options.threads || options.churn < 0 || options.churn > 1)
+        throw std::runtime_error("Invalid options!");
+    return options;
+}
+
+// Powers of two below the given count, then the count itself.
+std::vector<unsigned> thread_counts(unsigned threads) {
+    std::vector<unsigned> counts;
+    for (unsigned t = 1; t < threads; t *= 2)
+        counts.push_back(t);
+    counts.push_back(threads);
+    return counts;
+}
+
+long peak_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Runs setup and then body `repeat` times and returns the shortest time of
+// body alone.
+double best_of(unsigned repeat, const std::function<void()> &body, const std::function<void()> &setup) {
+    double best = std::numeric_limits<double>::infinity();
+    for (unsigned i = 0; i < repeat; ++i) {
+        if (setup)
+            setup();
+        auto begin = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - begin).count());
+    }
+    return best;
+}
+
+std::vector<std::string> off_files(const std::string &dirname) {
+    std::vector<std::string> files;
+    DIR *dir = opendir(dirname.c_str());
+    if (!dir) {
+        std::cerr << "Cannot open directory '" << dirname << "', only the cube grid is measured." << std::endl;
+        return files;
+    }
+
+    while (struct dirent *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".off") == 0)
+            files.push_back(dirname + "/" + name);
+    }
+    closedir(dir);
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// The convex decomposition of a mesh, from the cache next to it if the mesh
+// is unchanged, as the `new` command of the interactive program does.
+bool decomposition(const std::string &filename, std::vector<Polyhedron_3> &cells) {
+    try {
+        std::uint64_t hash = content_hash(filename);
+        std::string cache = filename + CELLS_SUFFIX;
+        if (read_cells(cache, hash, cells))
+            return true;
+
+        std::cerr << "Decomposing " << filename << "... " << std::flush;
+        std::ifstream ifs(filename.c_str());
+        DecompositionStats stats;
+        cells = convex_decomposition(ifs, stats);
+        std::cerr << "Done." << std::endl;
+        write_cells(cache, hash, cells);
+    } catch (const std::runtime_error &e) {
+        std::cerr << filename << ": " << e.what() << std::endl;
+        return !cells.empty();
+    }
+    return true;
+}
+
+void bounding_box(const std::vector<Polyhedron_3> &cells, double *lo, double *hi) {
+    std::fill(lo, lo + 3, std::numeric_limits<double>::infinity());
+    std::fill(hi, hi + 3, -std::numeric_limits<double>::infinity());
+    for (const Polyhedron_3 &poly : cells) {
+        for (auto p = poly.points_begin(); p != poly.points_end(); ++p) {
+            double c[3] = { CGAL::to_double(p->x()), CGAL::to_double(p->y()), CGAL::to_double(p->z()) };
+            for (int i = 0; i < 3; ++i) {
+                lo[i] = std::min(lo[i], c[i]);
+                hi[i] = std::max(hi[i], c[i]);
+            }
+        }
+    }
+}
+
+// Points spread uniformly over the bounding box of the cells, the same for
+// every run.
+std::vector<Point_3> query_points(const std::vector<Polyhedron_3> &cells, std::size_t n) {
+    double lo[3], hi[3];
+    bounding_box(cells, lo, hi);
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> x(lo[0], hi[0]), y(lo[1], hi[1]), z(lo[2], hi[2]);
+    std::vector<Point_3> points;
+    points.reserve(n);
+    for (std::size_t i = 0; i < n; ++i)
+        points.push_back(Point_3(x(rng), y(rng), z(rng)));
+    return points;
+}
+
+// Positions of particles taking `steps` random steps of up to 0.5% of the
+// bounding box per axis, all particles at step 0 first, then at step 1 and
+// so on; n points in all.
+std::vector<Point_3> moving_points(const std::vector<Polyhedron_3> &cells, std::size_t n, std::size_t steps) {
+    double lo[3], hi[3];
+    bounding_box(cells, lo, hi);
+
+    std::size_t particles = std::max<std::size_t>(1, n / steps);
+    std::vector<Point_3> start = query_points(cells, particles), points;
+    std::vector<double> x(3 * particles);
+    for (std::size_t i = 0; i < particles; ++i) {
+        x[3 * i] = CGAL::to_double(start[i].x());
+        x[3 * i + 1] = CGAL::to_double(start[i].y());
+        x[3 * i + 2] = CGAL::to_double(start[i].z());
+    }
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> step(-0.005, 0.005);
+    points.reserve(particles * steps);
+    for (std::size_t s = 0; s < steps; ++s) {
+        for (std::size_t i = 0; i < particles; ++i) {
+            double *c = &x[3 * i];
+            for (int k = 0; k < 3; ++k)
+                c[k] = std::min(hi[k], std::max(lo[k], c[k] + step(rng) * (hi[k] - lo[k])));
+            points.push_back(Point_3(c[0], c[1], c[2]));
+        }
+    }
+    return points;
+}
+
+void run(const Workload &w, const Options &options, std::vector<Result> &results) {
+    BuildOptions build;
+    BSPTree bsp;
+    std::vector<unsigned> sweep = thread_counts(options.threads);
+    auto record = [&](const std::string &benchmark, unsigned threads, double seconds, std::size_t ops, std::size_t found) {
+        Result r = { w.name, benchmark, threads, seconds, ops, found, bsp.stats(), peak_kb(), QueryStats() };
+        results.push_back(r);
+    };
+
+    double seconds;
+    for (unsigned t : sweep) {
+        build.threads = t;
+        seconds = best_of(options.repeat, [&]() {
+            bsp.rebuild(w.cells, build);
+        });
+        record("build", t, seconds, w.cells.size(), 0);
+    }
+
+    std::vector<Point_3> points = query_points(w.cells, options.queries);
+    std::vector<int> ids(points.size());
+    std::size_t found = 0;
+    auto count_found = [&](std::size_t n) {
+        return (std::size_t) std::count_if(ids.begin(), ids.begin() + n, [](int id) { return id >= 0; });
+    };
+    seconds = best_of(options.repeat, [&]() {
+        found = 0;
+        for (const Point_3 &p : points)
+            found += bsp.locate(p) != NULL;
+    });
+    record("locate", 1, seconds, points.size(), found);
+
+    for (unsigned t : sweep) {
+        seconds = best_of(options.repeat, [&]() {
+            bsp.locate_batch(points.data(), points.size(), ids.data(), t);
+        });
+        record("locate_batch", t, seconds, points.size(), count_found(points.size()));
+    }
+
+    // rays between consecutive query points
+    std::vector<K::Ray_3> rays;
+    for (std::size_t i = 0; i + 1 < points.size(); ++i) {
+        if (points[i] != points[i + 1])
+            rays.push_back(K::Ray_3(points[i], points[i + 1]));
+    }
+    seconds = best_of(options.repeat, [&]() {
+        bsp.first_hit_batch(rays.data(), rays.size(), ids.data());
+    });
+    record("first_hit_batch", 1, seconds, rays.size(), count_found(rays.size()));
+
+    // the query points spread over a box twice the size, so that most of
+    // them lie outside the cells and snap to the nearest one
+    double lo[3], hi[3];
+    bounding_box(w.cells, lo, hi);
+    std::vector<Point_3> around;
+    around.reserve(points.size());
+    for (const Point_3 &p : points) {
+        double c[3] = { CGAL::to_double(p.x()), CGAL::to_double(p.y()), CGAL::to_double(p.z()) };
+        for (int k = 0; k < 3; ++k)
+            c[k] = 2 * c[k] - (lo[k] + hi[k]) / 2;
+        around.push_back(Point_3(c[0], c[1], c[2]));
+    }
+    seconds = best_of(options.repeat, [&]() {
+        found = 0;
+        for (const Point_3 &p : around)
+            found += !bsp.nearest(p, 1).empty();
+    });
+    record("nearest", 1, seconds, around.size(), found);
+
+    // the same particles located from scratch and from their last cells
+    const std::size_t MOVING_STEPS = 100;
+    std::vector<Point_3> moving = moving_points(w.cells, options.queries, MOVING_STEPS);
+    std::size_t particles = moving.size() / MOVING_STEPS;
+    seconds = best_of(options.repeat, [&]() {
+        found = 0;
+        for (const Point_3 &p : moving)
+            found += bsp.locate(p) != NULL;
+    });
+    record("locate_moving", 1, seconds, moving.size(), found);
+
+    std::vector<const Polyhedron_3*> hints;
+    auto hinted = [&](QueryStats *queries) {
+        found = 0;
+        hints.assign(particles, NULL);
+        for (std::size_t i = 0; i < moving.size(); ++i) {
+            const Polyhedron_3 *&hint = hints[i % particles];
+            hint = queries ? bsp.locate(moving[i], hint, *queries) : bsp.locate(moving[i], hint);
+            found += hint != NULL;
+        }
+    };
+    seconds = best_of(options.repeat, [&]() {
+        hinted(NULL);
+    });
+    record("locate_hinted", 1, seconds, moving.size(), found);
+    hinted(&results.back().queries);
+
+    FrozenBSPTree frozen(bsp);
+    for (unsigned t : sweep) {
+        seconds = best_of(options.repeat, [&]() {
+            frozen.locate_batch(points.data(), points.size(), ids.data(), t);
+        });
+        record("frozen_locate_batch", t, seconds, points.size(), count_found(points.size()));
+    }
+
+    // readers sharing the frozen tree and one version of the snapshot tree,
+    // each locating a point at a time
+    const std::size_t READER_GRAIN = 1024;
+    for (unsigned t : sweep) {
+        seconds = best_of(options.repeat, [&]() {
+            parallel_for(points.size(), READER_GRAIN, t, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i)
+                    ids[i] = frozen.locate(points[i]);
+            });
+        });
+        record("frozen_locate", t, seconds, points.size(), count_found(points.size()));
+    }
+
+    {
+        SnapshotBSPTree snapshots(w.cells, build);
+        std::shared_ptr<const SnapshotBSPTree::Snapshot> snapshot = snapshots.snapshot();
+        for (unsigned t : sweep) {
+            seconds = best_of(options.repeat, [&]() {
+                parallel_for(points.size(), READER_GRAIN, t, [&](std::size_t begin, std::size_t end) {
+                    for (std::size_t i = begin; i < end; ++i)
+                        ids[i] = snapshot->locate(points[i]) ? 0 : -1;
+                });
+            });
+            record("snapshot_locate", t, seconds, points.size(), count_found(points.size()));
+        }
+    }
+
+    // the same random cells leave and come back in every repetition
+    std::vector<Polyhedron_3> churn(w.cells);
+    std::shuffle(churn.begin(), churn.end(), std::mt19937(2));
+    churn.resize(std::max<std::size_t>(1, churn.size() * options.churn));
+
+    seconds = best_of(options.repeat, [&]() {
+        for (const Polyhedron_3 &poly : churn)
+            bsp.remove(poly);
+    }, [&]() {
+        bsp.insert(churn);
+    });
+    record("remove", 1, seconds, churn.size(), 0);
+
+    seconds = best_of(options.repeat, [&]() {
+        for (const Polyhedron_3 &poly : churn)
+            bsp.insert(poly);
+    }, [&]() {
+        bsp.remove(churn);
+    });
+    record("insert", 1, seconds, churn.size(), 0);
+
+    seconds = best_of(options.repeat, [&]() {
+        bsp.remove(churn);
+    }, [&]() {
+        bsp.insert(churn);
+    });
+    record("remove_bulk", 1, seconds, churn.size(), 0);
+
+    seconds = best_of(options.repeat, [&]() {
+        bsp.insert(churn);
+    }, [&]() {
+        bsp.remove(churn);
+    });
+    record("insert_bulk", 1, seconds, churn.size(), 0);
+}
+
+void print_table(const std::vector<Result> &results) {
+    std::cout << std::left << std::setw(24) << "workload" << std::setw(22) << "benchmark"
+        << std::right << std::setw(8) << "threads" << std::setw(12) << "time (s)" << std::setw(12) << "ns/op"
+        << std::setw(10) << "found"
+        << std::setw(10) << "nodes" << std::setw(7) << "depth" << std::setw(9) << "avg"
+        << std::setw(12) << "peak (kB)" << std::setw(8) << "hits" << std::endl;
+    for (const Result &r : results) {
+        std::cout << std::left << std::setw(24) << r.workload << std::setw(22) << r.benchmark
+            << std::right << std::setw(8) << r.threads
+            << std::fixed << std::setprecision(6) << std::setw(12) << r.seconds
+            << std::setprecision(0) << std::setw(12) << 1e9 * r.seconds / r.ops
+            << std::setw(10) << r.found
+            << std::setw(10) << r.stats.nodes << std::setw(7) << r.stats.max_depth
+            << std::setprecision(2) << std::setw(9) << r.stats.average_depth
+            << std::setw(12) << r.peak_kb;
+        // share of hinted queries answered without descending the tree
+        if (r.queries.hinted)
+            std::cout << std::setprecision(1) << std::setw(7)
+                << 100.0 * (r.queries.hint_hits + r.queries.walk_hits) / r.queries.hinted << "%";
+        std::cout << std::endl;
+    }
+}
+
+std::string json_string(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+void print_json(const std::vector<Result> &results) {
+    std::cout << "[" << std::endl;
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        std::cout << "  {\"workload\": " << json_string(r.workload)
+            << ", \"benchmark\": " << json_string(r.benchmark)
+            << ", \"threads\": " << r.threads
+            << ", \"seconds\": " << std::setprecision(9) << r.seconds
+            << ", \"ops\": " << r.ops
+            << ", \"ns_per_op\": " << 1e9 * r.seconds / r.ops
+            << ", \"found\": " << r.found
+            << ", \"nodes\": " << r.stats.nodes
+            << ", \"leaves\": " << r.stats.leaves
+            << ", \"max_depth\": " << r.stats.max_depth
+            << ", \"average_depth\": " << r.stats.average_depth
+            << ", \"boundary_total\": " << r.stats.boundary_total
+            << ", \"boundary_max\": " << r.stats.boundary_max
+            << ", \"node_bytes\": " << r.stats.node_bytes
+            << ", \"cell_bytes\": " << r.stats.cell_bytes
+            << ", \"peak_kb\": " << r.peak_kb;
+        if (r.queries.hinted)
+            std::cout << ", \"hint_hit_rate\": " << double(r.queries.hint_hits) / r.queries.hinted
+                << ", \"walk_hit_rate\": " << double(r.queries.walk_hits) / r.queries.hinted;
+        std::cout << "}"
+            << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    std::cout << "]" << std::endl;
+}
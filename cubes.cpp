@@ -0,0 +1,34 @@
+#include <algorithm>
+
+#include <CGAL/convex_hull_3.h>
+
+#include "cubes.h"
+
+Polyhedron_3 cube(const Point_3 &p, const CGAL::Gmpq &h,
+        const CGAL::Gmpq &w, const CGAL::Gmpq &d) {
+    std::vector<Point_3> points;
+    for (auto &x: {p.x(), p.x() + h})
+        for (auto &y: {p.y(), p.y() + w})
+            for (auto &z: {p.z(), p.z() + d})
+                points.push_back(Point_3(x, y, z));
+
+    Polyhedron_3 P;
+    CGAL::convex_hull_3(points.begin(), points.end(), P);
+    std::transform(P.facets_begin(), P.facets_end(), P.planes_begin(),
+            Plane_equation());
+
+    return P;
+
+}
+
+void cubes(unsigned int hn, unsigned int wn, unsigned int dn,
+        std::vector<Polyhedron_3> &v) {
+    v.clear();
+    for (int x = 0; x <= hn; ++x) {
+        for (int y = 0; y <= wn; ++y) {
+            for (int z = 0; z <= dn; ++z) {
+                v.push_back(cube(Point_3(x, y, z), 1, 1, 1));
+            }
+        }
+    }
+}
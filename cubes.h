@@ -0,0 +1,15 @@
+#ifndef CUBES_H
+#define CUBES_H
+
+#include <vector>
+
+#include "bsp.h"
+
+// Axis-aligned box with corner p and sides h, w and d, with its planes set.
+Polyhedron_3 cube(const Point_3&, const CGAL::Gmpq&,
+        const CGAL::Gmpq&, const CGAL::Gmpq&);
+// Unit cubes filling the grid [0, hn + 1] x [0, wn + 1] x [0, dn + 1].
+void cubes(unsigned int, unsigned int, unsigned int,
+        std::vector<Polyhedron_3>&);
+
+#endif // CUBES_H
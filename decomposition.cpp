@@ -0,0 +1,557 @@
+#include <cstdio>
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <unordered_map>
+
+#include <CGAL/Nef_polyhedron_3.h>
+#include <CGAL/OFF_to_nef_3.h>
+#include <CGAL/convex_decomposition_3.h>
+#include <CGAL/Modifier_base.h>
+#include <CGAL/Polyhedron_incremental_builder_3.h>
+
+#include "decomposition.h"
+#include "parallel.h"
+
+namespace {
+
+const std::string CELLS_MAGIC = "BSPCELLS";
+const int CELLS_VERSION = 1;
+
+// CLASS CellBuilder
+// Rebuilds a polyhedron from indexed facets in the order they were written.
+
+template <class HDS>
+class CellBuilder : public CGAL::Modifier_base<HDS> {
+    const std::vector<Point_3> &points;
+    const std::vector<std::vector<std::size_t> > &facets;
+
+    public:
+
+        CellBuilder(const std::vector<Point_3> &_points,
+                const std::vector<std::vector<std::size_t> > &_facets)
+            : points(_points), facets(_facets) {}
+
+        void operator()(HDS &hds) {
+            CGAL::Polyhedron_incremental_builder_3<HDS> builder(hds);
+            builder.begin_surface(points.size(), facets.size());
+            for (const Point_3 &p : points)
+                builder.add_vertex(p);
+            for (const std::vector<std::size_t> &facet : facets)
+                builder.add_facet(facet.begin(), facet.end());
+            builder.end_surface();
+            if (builder.error())
+                throw std::runtime_error("Invalid cell in cache!");
+        }
+};
+
+// Builds P from points and indexed facets, returns false if they do not
+// form a valid polyhedral surface.
+bool build_cell(const std::vector<Point_3> &points,
+        const std::vector<std::vector<std::size_t> > &facets, Polyhedron_3 &P) {
+    try {
+        CellBuilder<CGALPolyhedron_3::HalfedgeDS> builder(points, facets);
+        P.delegate(builder);
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+    return P.size_of_facets() == facets.size();
+}
+
+bool read_cell(std::istream &is, Polyhedron_3 &P) {
+    std::size_t nv, nf;
+    if (!(is >> nv >> nf) || nv < 4 || nf < 4)
+        return false;
+
+    std::vector<Point_3> points;
+    points.reserve(nv);
+    for (std::size_t i = 0; i < nv; ++i) {
+        K::FT x, y, z;
+        if (!(is >> x >> y >> z))
+            return false;
+        points.push_back(Point_3(x, y, z));
+    }
+
+    std::vector<std::vector<std::size_t> > facets(nf);
+    std::vector<Plane_3> planes;
+    planes.reserve(nf);
+    for (std::vector<std::size_t> &facet : facets) {
+        std::size_t degree;
+        if (!(is >> degree) || degree < 3)
+            return false;
+        facet.resize(degree);
+        for (std::size_t &v : facet)
+            if (!(is >> v) || v >= nv)
+                return false;
+
+        K::FT a, b, c, d;
+        if (!(is >> a >> b >> c >> d))
+            return false;
+        planes.push_back(Plane_3(a, b, c, d));
+    }
+
+    if (!build_cell(points, facets, P))
+        return false;
+    std::copy(planes.begin(), planes.end(), P.planes_begin());
+    return true;
+}
+
+// Reads the next line that is neither empty nor a comment.
+bool next_line(std::istream &is, std::string &s) {
+    while (std::getline(is, s)) {
+        std::size_t comment = s.find('#');
+        if (comment != std::string::npos)
+            s.erase(comment);
+        if (s.find_first_not_of(" \t\r") != std::string::npos)
+            return true;
+    }
+    return false;
+}
+
+std::size_t find_root(std::vector<std::size_t> &parent, std::size_t i) {
+    while (parent[i] != i)
+        i = parent[i] = parent[parent[i]];
+    return i;
+}
+
+struct Component {
+    double lo[3], hi[3];
+    std::size_t group;
+};
+
+// Splits a mesh in .off format into its connected components, joins those
+// with overlapping bounding boxes and writes every resulting group as a mesh
+// of its own. Returns the number of components, or 0 if the mesh is not
+// plain OFF and has to be decomposed whole.
+std::size_t split_components(const std::string &text, std::vector<std::string> &groups) {
+    std::istringstream is(text);
+    std::string s, magic;
+    std::size_t nv, nf;
+    if (!next_line(is, s))
+        return 0;
+    std::istringstream header(s);
+    header >> magic;
+    if (magic != "OFF")
+        return 0;
+    // the counts may follow OFF on the same line
+    if (!(header >> nv)) {
+        if (!next_line(is, s))
+            return 0;
+        header.clear();
+        header.str(s);
+        header >> nv;
+    }
+    if (!(header >> nf))
+        return 0;
+
+    std::vector<std::string> vertices(nv);
+    std::vector<double> coords(3 * nv);
+    for (std::size_t i = 0; i < nv; ++i) {
+        if (!next_line(is, vertices[i]) ||
+                !(std::istringstream(vertices[i]) >> coords[3 * i] >> coords[3 * i + 1] >> coords[3 * i + 2]))
+            return 0;
+    }
+
+    std::vector<std::vector<std::size_t> > facets(nf);
+    std::vector<std::size_t> parent(nv);
+    for (std::size_t i = 0; i < nv; ++i)
+        parent[i] = i;
+    for (std::vector<std::size_t> &facet : facets) {
+        // anything after the indices, such as a color, is dropped
+        std::size_t degree;
+        if (!next_line(is, s))
+            return 0;
+        std::istringstream fs(s);
+        if (!(fs >> degree) || degree == 0)
+            return 0;
+        facet.resize(degree);
+        for (std::size_t &v : facet) {
+            if (!(fs >> v) || v >= nv)
+                return 0;
+            std::size_t a = find_root(parent, v), b = find_root(parent, facet[0]);
+            parent[a] = b;
+        }
+    }
+
+    // vertices outside every facet belong to no component
+    const std::size_t NONE = std::size_t(-1);
+    std::vector<std::size_t> component(nv, NONE);
+    for (const std::vector<std::size_t> &facet : facets)
+        for (std::size_t v : facet)
+            component[v] = 0;
+
+    std::vector<Component> components;
+    std::vector<std::size_t> root_component(nv, NONE);
+    for (std::size_t v = 0; v < nv; ++v) {
+        if (component[v] == NONE)
+            continue;
+        std::size_t &c = root_component[find_root(parent, v)];
+        if (c == NONE) {
+            c = components.size();
+            Component comp;
+            std::copy(&coords[3 * v], &coords[3 * v] + 3, comp.lo);
+            std::copy(&coords[3 * v], &coords[3 * v] + 3, comp.hi);
+            components.push_back(comp);
+        }
+        component[v] = c;
+        for (int i = 0; i < 3; ++i) {
+            components[c].lo[i] = std::min(components[c].lo[i], coords[3 * v + i]);
+            components[c].hi[i] = std::max(components[c].hi[i], coords[3 * v + i]);
+        }
+    }
+
+    // sweep along x and join components whose boxes touch
+    std::vector<std::size_t> order(components.size()), group_parent(components.size());
+    for (std::size_t c = 0; c < components.size(); ++c)
+        order[c] = group_parent[c] = c;
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return components[a].lo[0] < components[b].lo[0];
+    });
+    std::vector<std::size_t> active;
+    for (std::size_t c : order) {
+        const Component &comp = components[c];
+        active.erase(std::remove_if(active.begin(), active.end(), [&](std::size_t o) {
+            return components[o].hi[0] < comp.lo[0];
+        }), active.end());
+        for (std::size_t o : active) {
+            const Component &other = components[o];
+            if (comp.lo[1] <= other.hi[1] && other.lo[1] <= comp.hi[1] &&
+                    comp.lo[2] <= other.hi[2] && other.lo[2] <= comp.hi[2]) {
+                std::size_t a = find_root(group_parent, c), b = find_root(group_parent, o);
+                group_parent[a] = b;
+            }
+        }
+        active.push_back(c);
+    }
+
+    // groups numbered in the order of their first vertex
+    std::vector<std::size_t> group_index(components.size(), NONE);
+    std::vector<std::vector<std::size_t> > group_vertices;
+    std::vector<std::size_t> local(nv);
+    for (std::size_t v = 0; v < nv; ++v) {
+        if (component[v] == NONE)
+            continue;
+        std::size_t &g = group_index[find_root(group_parent, component[v])];
+        if (g == NONE) {
+            g = group_vertices.size();
+            group_vertices.push_back(std::vector<std::size_t>());
+        }
+        local[v] = group_vertices[g].size();
+        group_vertices[g].push_back(v);
+    }
+
+    std::vector<std::vector<const std::vector<std::size_t>*> > group_facets(group_vertices.size());
+    for (const std::vector<std::size_t> &facet : facets)
+        group_facets[group_index[find_root(group_parent, component[facet[0]])]].push_back(&facet);
+
+    groups.clear();
+    for (std::size_t g = 0; g < group_vertices.size(); ++g) {
+        std::ostringstream os;
+        os << "OFF\n" << group_vertices[g].size() << " " << group_facets[g].size() << " 0\n";
+        for (std::size_t v : group_vertices[g])
+            os << vertices[v] << "\n";
+        for (const std::vector<std::size_t> *facet : group_facets[g]) {
+            os << facet->size();
+            for (std::size_t v : *facet)
+                os << " " << local[v];
+            os << "\n";
+        }
+        groups.push_back(os.str());
+    }
+    return components.size();
+}
+
+std::vector<Polyhedron_3> decompose(std::istream &is, DecompositionStats &stats) {
+    typedef CGAL::Nef_polyhedron_3<K> Nef_3;
+    typedef Nef_3::Volume_const_iterator Volume_const_iterator;
+
+    Nef_3 N;
+    stats.discarded = CGAL::OFF_to_nef_3(is, N, true);
+    stats.vertices = N.number_of_vertices();
+    stats.edges = N.number_of_edges();
+    stats.facets = N.number_of_facets();
+    stats.volumes = N.number_of_volumes();
+
+    CGAL::convex_decomposition_3(N);
+
+    std::vector<Polyhedron_3> convex_parts;
+    // the first volume is the outer volume, which is
+    // ignored in the decomposition
+    Volume_const_iterator ci = ++N.volumes_begin();
+    for( ; ci != N.volumes_end(); ++ci) {
+        if(ci->mark()) {
+            Polyhedron_3 P;
+            N.convert_inner_shell_to_polyhedron(ci->shells_begin(), P);
+            std::transform(P.facets_begin(), P.facets_end(), P.planes_begin(),
+                    Plane_equation());
+            convex_parts.push_back(P);
+        }
+    }
+    return convex_parts;
+}
+
+void write_cell(std::ostream &os, const Polyhedron_3 &P) {
+    typedef CGALPolyhedron_3::Vertex Vertex;
+
+    std::unordered_map<const Vertex*, std::size_t> index;
+    std::size_t next = 0;
+    os << P.size_of_vertices() << " " << P.size_of_facets() << "\n";
+    for (auto v = P.vertices_begin(); v != P.vertices_end(); ++v) {
+        index[&*v] = next++;
+        os << v->point().x() << " " << v->point().y() << " " << v->point().z() << "\n";
+    }
+
+    for (auto f = P.facets_begin(); f != P.facets_end(); ++f) {
+        os << f->facet_degree();
+        auto h = f->halfedge();
+        do {
+            os << " " << index.at(&*h->vertex());
+            h = h->next();
+        } while (h != f->halfedge());
+        const Plane_3 &plane = f->plane();
+        os << " " << plane.a() << " " << plane.b() << " " << plane.c() << " " << plane.d() << "\n";
+    }
+}
+
+}
+
+void convex_decomposition(std::istream &is, DecompositionStats &stats, const CellSink &sink,
+        unsigned threads) {
+    std::string text((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    std::vector<std::string> groups;
+    stats.components = split_components(text, groups);
+    if (groups.size() < 2) {
+        groups.assign(1, std::move(text));
+        stats.components = std::max<std::size_t>(stats.components, 1);
+    }
+    stats.groups = groups.size();
+
+    // the largest groups first, so that no thread is left with one at the end
+    std::vector<std::size_t> order(groups.size());
+    for (std::size_t g = 0; g < groups.size(); ++g)
+        order[g] = g;
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return groups[a].size() > groups[b].size();
+    });
+
+    // every group gets Nef polyhedra of its own, which share nothing with
+    // the other groups
+    std::vector<DecompositionStats> group_stats(groups.size());
+    std::mutex sink_mutex;
+    parallel_for(groups.size(), 1, threads, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            std::size_t g = order[i];
+            std::istringstream gis(groups[g]);
+            std::vector<Polyhedron_3> parts = decompose(gis, group_stats[g]);
+            std::lock_guard<std::mutex> lock(sink_mutex);
+            sink(g, std::move(parts));
+        }
+    });
+
+    stats.vertices = stats.edges = stats.facets = stats.volumes = stats.discarded = 0;
+    for (const DecompositionStats &gs : group_stats) {
+        stats.vertices += gs.vertices;
+        stats.edges += gs.edges;
+        stats.facets += gs.facets;
+        stats.volumes += gs.volumes;
+        stats.discarded += gs.discarded;
+    }
+    // the outer volume is counted once
+    stats.volumes -= groups.size() - 1;
+}
+
+std::vector<Polyhedron_3> convex_decomposition(std::istream &is, DecompositionStats &stats,
+        unsigned threads) {
+    std::vector<std::vector<Polyhedron_3> > parts;
+    convex_decomposition(is, stats, [&](std::size_t group, std::vector<Polyhedron_3> &&cells) {
+        if (parts.size() <= group)
+            parts.resize(group + 1);
+        parts[group] = std::move(cells);
+    }, threads);
+
+    std::vector<Polyhedron_3> convex_parts;
+    for (std::vector<Polyhedron_3> &group : parts)
+        std::move(group.begin(), group.end(), std::back_inserter(convex_parts));
+    return convex_parts;
+}
+
+std::uint64_t content_hash(const std::string &filename) {
+    std::ifstream ifs(filename.c_str(), std::ios::binary);
+    if (!ifs)
+        throw std::runtime_error("Cannot open file '" + filename + "'!");
+
+    std::uint64_t hash = 14695981039346656037ull;
+    char buffer[1 << 16];
+    while (ifs.read(buffer, sizeof(buffer)) || ifs.gcount()) {
+        for (std::streamsize i = 0; i < ifs.gcount(); ++i) {
+            hash ^= (unsigned char) buffer[i];
+            hash *= 1099511628211ull;
+        }
+    }
+    if (ifs.bad())
+        throw std::runtime_error("Cannot read file '" + filename + "'!");
+    return hash;
+}
+
+void write_cells(const std::string &filename, std::uint64_t hash,
+        const std::vector<Polyhedron_3> &cells) {
+    // written aside and renamed, so that an interrupted write never leaves
+    // a truncated cache behind
+    std::string tmp = filename + ".tmp";
+    {
+        std::ofstream ofs(tmp.c_str());
+        if (!ofs)
+            throw std::runtime_error("Cannot open file '" + tmp + "'!");
+
+        ofs << CELLS_MAGIC << " " << CELLS_VERSION << "\n"
+            << std::hex << hash << std::dec << "\n"
+            << cells.size() << "\n";
+        for (const Polyhedron_3 &P : cells)
+            write_cell(ofs, P);
+
+        if (!ofs.flush()) {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Cannot write file '" + tmp + "'!");
+        }
+    }
+
+    if (std::rename(tmp.c_str(), filename.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Cannot write file '" + filename + "'!");
+    }
+}
+
+bool read_cells(const std::string &filename, std::uint64_t hash,
+        std::vector<Polyhedron_3> &cells) {
+    cells.clear();
+
+    std::ifstream ifs(filename.c_str());
+    if (!ifs)
+        return false;
+
+    std::string magic;
+    int version;
+    std::uint64_t stored;
+    std::size_t n;
+    if (!(ifs >> magic >> version) || magic != CELLS_MAGIC || version != CELLS_VERSION)
+        return false;
+    if (!(ifs >> std::hex >> stored >> std::dec) || stored != hash)
+        return false;
+    if (!(ifs >> n))
+        return false;
+
+    for (std::size_t i = 0; i < n; ++i) {
+        Polyhedron_3 P;
+        if (!read_cell(ifs, P)) {
+            cells.clear();
+            return false;
+        }
+        cells.push_back(P);
+    }
+    return true;
+}
+
+// CLASS OFFCellReader
+
+OFFCellReader::OFFCellReader(std::istream &_is) : is(_is), _count(0) {}
+
+bool OFFCellReader::line(std::string &s) {
+    return next_line(is, s);
+}
+
+bool OFFCellReader::next(Polyhedron_3 &P) {
+    std::string s;
+    if (!line(s))
+        return false;
+
+    std::string cell = "Cell #" + std::to_string(_count + 1);
+    std::istringstream header(s);
+    std::string magic;
+    std::size_t nv, nf;
+    header >> magic;
+    if (magic != "OFF")
+        throw std::runtime_error(cell + " does not start with OFF!");
+    // the counts may follow OFF on the same line
+    if (!(header >> nv)) {
+        if (!line(s))
+            throw std::runtime_error(cell + " has no vertex and facet counts!");
+        header.clear();
+        header.str(s);
+        header >> nv;
+    }
+    if (!(header >> nf))
+        throw std::runtime_error(cell + " has no vertex and facet counts!");
+    if (nv < 4 || nf < 4)
+        throw std::runtime_error(cell + " is degenerate!");
+
+    std::vector<Point_3> points;
+    points.reserve(nv);
+    for (std::size_t i = 0; i < nv; ++i) {
+        Point_3 p;
+        if (!line(s) || !(std::istringstream(s) >> p))
+            throw std::runtime_error(cell + " has an invalid vertex!");
+        points.push_back(p);
+    }
+
+    std::vector<std::vector<std::size_t> > facets(nf);
+    for (std::vector<std::size_t> &facet : facets) {
+        // anything after the indices, such as a color, is ignored
+        if (!line(s))
+            throw std::runtime_error(cell + " has an invalid facet!");
+        std::istringstream fs(s);
+        std::size_t degree;
+        if (!(fs >> degree) || degree < 3)
+            throw std::runtime_error(cell + " has an invalid facet!");
+        facet.resize(degree);
+        for (std::size_t &v : facet)
+            if (!(fs >> v) || v >= nv)
+                throw std::runtime_error(cell + " has an invalid facet!");
+    }
+
+    P = Polyhedron_3();
+    if (!build_cell(points, facets, P))
+        throw std::runtime_error(cell + " is not a closed polyhedron!");
+
+    // the facets may be wound either way, as long as the cell lies on one
+    // side of every facet plane
+    for (auto f = P.facets_begin(); f != P.facets_end(); ++f) {
+        std::vector<Point_3> corners;
+        auto h = f->halfedge();
+        do {
+            corners.push_back(h->vertex()->point());
+            h = h->next();
+        } while (h != f->halfedge());
+
+        // the plane of the first corners that are not collinear
+        Plane_3 plane(corners[0], corners[1], corners[2]);
+        for (std::size_t i = 2; i + 1 < corners.size() && plane.is_degenerate(); ++i)
+            plane = Plane_3(corners[0], corners[i], corners[i + 1]);
+        if (plane.is_degenerate())
+            throw std::runtime_error(cell + " has a degenerate facet!");
+        for (const Point_3 &p : corners)
+            if (!plane.has_on(p))
+                throw std::runtime_error(cell + " has a facet that is not planar!");
+
+        bool negative = false, positive = false;
+        for (const Point_3 &p : points) {
+            CGAL::Oriented_side side = plane.oriented_side(p);
+            negative |= side == CGAL::ON_NEGATIVE_SIDE;
+            positive |= side == CGAL::ON_POSITIVE_SIDE;
+        }
+        if (negative && positive)
+            throw std::runtime_error(cell + " is not convex!");
+        if (!negative && !positive)
+            throw std::runtime_error(cell + " is degenerate!");
+        f->plane() = plane;
+    }
+
+    ++_count;
+    return true;
+}
+
+std::size_t OFFCellReader::count() const {
+    return _count;
+}
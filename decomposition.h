@@ -0,0 +1,80 @@
+#ifndef DECOMPOSITION_H
+#define DECOMPOSITION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "bsp.h"
+
+// Sizes of the Nef polyhedra the decomposition was computed from, summed
+// over the groups the mesh was split into.
+struct DecompositionStats {
+    std::size_t vertices, edges, facets, volumes, discarded;
+    // connected components of the mesh and the groups they were decomposed in
+    std::size_t components, groups;
+};
+
+// Receives the convex parts of one group as soon as it is decomposed. Calls
+// never overlap but come in no particular order.
+typedef std::function<void(std::size_t group, std::vector<Polyhedron_3>&&)> CellSink;
+
+// Suffix of the cache file kept next to an .off file.
+const std::string CELLS_SUFFIX = ".cells";
+
+// Reads a mesh in .off format and splits it into convex parts with
+// OFF_to_nef_3 and convex_decomposition_3. Every part has its facet planes
+// set.
+//
+// Connected components whose bounding boxes are disjoint cannot affect
+// each other, so they are decomposed separately, on `threads` threads (0
+// means one per core). Components with overlapping boxes, such as a shell
+// and the cavities inside it, stay in one group.
+void convex_decomposition(std::istream&, DecompositionStats&, const CellSink&,
+        unsigned threads = 0);
+
+// The same, returning all parts in the order of the groups.
+std::vector<Polyhedron_3> convex_decomposition(std::istream&, DecompositionStats&,
+        unsigned threads = 0);
+
+// 64-bit FNV-1a hash of the contents of a file.
+std::uint64_t content_hash(const std::string &filename);
+
+// Stores convex parts with their exact coordinates and planes, tagged with
+// the hash of the mesh they were computed from.
+void write_cells(const std::string &filename, std::uint64_t hash,
+        const std::vector<Polyhedron_3>&);
+
+// Reads parts stored by write_cells. Returns false, leaving the vector
+// empty, when the file is missing, unreadable or was written for a mesh
+// with another hash.
+bool read_cells(const std::string &filename, std::uint64_t hash,
+        std::vector<Polyhedron_3>&);
+
+// CLASS OFFCellReader
+// Reads already convex cells from a stream of concatenated OFF shells, one
+// shell per cell, without going through Nef polyhedra. Cells are parsed one
+// at a time, so only the cell being read is held in memory.
+
+class OFFCellReader {
+    std::istream &is;
+    std::size_t _count;
+
+    bool line(std::string&);
+
+    public:
+
+        explicit OFFCellReader(std::istream&);
+
+        // Reads the next cell and sets its facet planes. Returns false at the
+        // end of the stream and throws on malformed or non-convex cells.
+        bool next(Polyhedron_3&);
+
+        // Number of cells read so far.
+        std::size_t count() const;
+};
+
+#endif // DECOMPOSITION_H
@@ -11,44 +11,72 @@
 #include <CGAL/IO/Polyhedron_iostream.h>
 #include <CGAL/convex_hull_3.h>
 #include <CGAL/enum.h>
-#include <CGAL/Nef_polyhedron_3.h>
-#include <CGAL/IO/Nef_polyhedron_iostream_3.h>
-#include <CGAL/OFF_to_nef_3.h>
-#include <CGAL/convex_decomposition_3.h>
 
 #include "bsp.h"
+#include "decomposition.h"
+#include "cubes.h"
 
 struct MenuData {
     BSPTree bsp;
+    // answers queries, made again after every change to bsp
+    FrozenBSPTree frozen;
+    // frozen was loaded from a file, bsp and polys are empty
+    bool loaded = false;
     std::map<int, Polyhedron_3> polys;
+    BuildOptions options;
+    // work done by `loc` since the last `stats`
+    QueryStats queries;
+    // ignore cached decompositions of .off files
+    bool recompute = false;
 };
 
 const std::string HELP = "h",
       EXIT = "q",
       LOCATE = "loc",
+      RAY = "ray",
+      RANGE = "range",
+      NEAR = "near",
       NEW = "new",
+      CELLS = "cells",
       ADD = "add",
       CLEAR = "cl",
       REMOVE = "rm",
-      PRINT = "out";
+      PRINT = "out",
+      SPLIT = "split",
+      STATS = "stats",
+      SAVE = "save",
+      LOAD = "load";
 
 void help();
 bool again();
-void locate(std::istringstream&, const MenuData&);
+void error(const std::string&);
+bool reject_loaded(const std::string&, const MenuData&);
+void locate(std::istringstream&, MenuData&);
+void ray(std::istringstream&, const MenuData&);
+void range(std::istringstream&, const MenuData&);
+void near(std::istringstream&, const MenuData&);
 void new_bsp(std::istringstream&, MenuData&);
-void add(std::istringstream&, MenuData&);
-void rm(std::istringstream&, MenuData&);
+void new_cells(std::istringstream&, MenuData&);
+bool add(std::istringstream&, MenuData&);
+bool rm(std::istringstream&, MenuData&);
 void out(std::istringstream&, const MenuData&);
-Polyhedron_3 cube(const Point_3&, const CGAL::Gmpq&,
-        const CGAL::Gmpq&, const CGAL::Gmpq&);
-void cubes(unsigned int, unsigned int, unsigned int,
-        std::vector<Polyhedron_3>&);
+void split(std::istringstream&, MenuData&);
+void stats(MenuData&);
+void save(std::istringstream&, const MenuData&);
+void load(const std::string&, MenuData&);
 
 int main(int argc, char **argv) {
     std::cout << "Welcome! Use `h` for help." << std::endl;
 
     std::string line;
     MenuData md;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "-f")
+            md.recompute = true;
+        else
+            load(argv[i], md);
+    }
+
     while ((std::cout << "> ") && std::getline(std::cin, line)) {
         if (line.empty())
             continue;
@@ -65,21 +93,59 @@ int main(int argc, char **argv) {
         else if (command == LOCATE) {
             locate(iss, md);
         }
+        else if (command == RAY) {
+            ray(iss, md);
+        }
+        else if (command == RANGE) {
+            range(iss, md);
+        }
+        else if (command == NEAR) {
+            near(iss, md);
+        }
         else if (command == NEW) {
             new_bsp(iss, md);
+            md.frozen = FrozenBSPTree(md.bsp);
+            md.loaded = false;
+        }
+        else if (command == CELLS) {
+            new_cells(iss, md);
+            md.frozen = FrozenBSPTree(md.bsp);
+            md.loaded = false;
         }
         else if (command == ADD) {
-            add(iss, md);
+            if (add(iss, md))
+                md.frozen = FrozenBSPTree(md.bsp);
         }
         else if (command == REMOVE) {
-            rm(iss, md);
+            if (rm(iss, md))
+                md.frozen = FrozenBSPTree(md.bsp);
         }
         else if (command == PRINT) {
             out(iss, md);
         }
+        else if (command == SPLIT) {
+            split(iss, md);
+        }
+        else if (command == STATS) {
+            stats(md);
+        }
+        else if (command == SAVE) {
+            save(iss, md);
+        }
+        else if (command == LOAD) {
+            std::string filename;
+            if (iss >> filename)
+                load(filename, md);
+            else {
+                error("Invalid input!");
+                std::cout << "Usage: " << LOAD << " filename" << std::endl;
+            }
+        }
         else if (command == CLEAR) {
             if (again()) {
                 md.bsp.clear();
+                md.frozen = FrozenBSPTree();
+                md.loaded = false;
                 md.polys.clear();
                 std::cout << "Cleared." << std::endl;
             }
@@ -97,9 +163,20 @@ void help() {
         << "  " << HELP << std::endl
         << "Locate point in BSP tree:" << std::endl
         << "  " << LOCATE << " x y z [filename]" << std::endl
+        << "List polyhedra met by a segment, front to back:" << std::endl
+        << "  " << RAY << " x y z x y z" << std::endl
+        << "List polyhedra meeting a box or the half-space a x + b y + c z + d <= 0:" << std::endl
+        << "  " << RANGE << " x y z x y z" << std::endl
+        << "  " << RANGE << " a b c d" << std::endl
+        << "List the k polyhedra nearest to a point, 1 by default:" << std::endl
+        << "  " << NEAR << " x y z [k]" << std::endl
         << "Create new BSP tree:" << std::endl
         << "  " << NEW << " h w d" << std::endl
         << "  " << NEW << " filename" << std::endl
+        << "  (the decomposition of filename is cached in filename" << CELLS_SUFFIX
+        << ", start with -f to recompute it)" << std::endl
+        << "Create new BSP tree from a file of convex cells, one OFF shell each:" << std::endl
+        << "  " << CELLS << " filename" << std::endl
         << "Add new convex polyhedron:" << std::endl
         << "  " << ADD << " [filename]" << std::endl
         << "Remove polyhedron from BSP tree:" << std::endl
@@ -108,6 +185,14 @@ void help() {
         << "  " << CLEAR << std::endl
         << "Print BSP tree:" << std::endl
         << "  " << PRINT << std::endl
+        << "Choose splitting planes of the next " << NEW << ":" << std::endl
+        << "  " << SPLIT << " (first | balance | straddle | sah) [candidates]" << std::endl
+        << "Print BSP tree statistics and the work done by `" << LOCATE << "` since the last time:" << std::endl
+        << "  " << STATS << std::endl
+        << "Save BSP tree for fast loading:" << std::endl
+        << "  " << SAVE << " filename" << std::endl
+        << "Load saved BSP tree (answers `" << LOCATE << "` with ids only until the next `" << NEW << "`, `" << CELLS << "` or `" << CLEAR << "`):" << std::endl
+        << "  " << LOAD << " filename" << std::endl
         << "Exit the program:" << std::endl
         << "  " << EXIT << std::endl;
 }
@@ -123,7 +208,17 @@ void error(const std::string &msg) {
     std::cout << "ERROR: " << msg << std::endl;
 }
 
+// A loaded tree has no meshes and answers `loc` only.
+bool reject_loaded(const std::string &command, const MenuData &md) {
+    if (md.loaded)
+        error("`" + command + "` does not apply to a loaded tree, use `" + NEW + "` or `" + CELLS + "` to build one!");
+    return md.loaded;
+}
+
 void out(std::istringstream &iss, const MenuData &md) {
+    if (reject_loaded(PRINT, md))
+        return;
+
     std::string filename;
     std::ofstream ofs;
     if (!(iss >> filename) || !(ofs = std::ofstream(filename.c_str()))) {
@@ -133,7 +228,96 @@ void out(std::istringstream &iss, const MenuData &md) {
     ofs << md.bsp << std::endl;
 }
 
-void locate(std::istringstream &iss, const MenuData &md) {
+void split(std::istringstream &iss, MenuData &md) {
+    std::string name;
+    iss >> name;
+
+    BuildOptions options = md.options;
+    if (name == "first")
+        options.heuristic = SPLIT_FIRST;
+    else if (name == "balance")
+        options.heuristic = SPLIT_BALANCE;
+    else if (name == "straddle")
+        options.heuristic = SPLIT_MIN_STRADDLE;
+    else if (name == "sah")
+        options.heuristic = SPLIT_SAH;
+    else {
+        error("Invalid input!");
+        std::cout << "Usage: " << SPLIT << " (first | balance | straddle | sah) [candidates]" << std::endl
+            << "  first - first plane dividing the polyhedra" << std::endl
+            << "  balance - fewest cut polyhedra and equal halves" << std::endl
+            << "  straddle - fewest cut polyhedra" << std::endl
+            << "  sah - shortest expected path, weighted by volume" << std::endl
+            << "  candidates - planes tried per node, 0 for all" << std::endl;
+        return;
+    }
+
+    std::size_t candidates;
+    if (iss >> candidates)
+        options.max_candidates = candidates;
+
+    md.options = options;
+    std::cout << "Done." << std::endl;
+}
+
+void stats(MenuData &md) {
+    if (md.loaded)
+        std::cout << "  loaded tree of " << md.frozen.size() << " cells, no further statistics" << std::endl;
+    else {
+        TreeStats st = md.bsp.stats();
+        std::cout << "  nodes: " << st.nodes << std::endl
+            << "  leaves: " << st.leaves << std::endl
+            << "  max depth: " << st.max_depth << std::endl
+            << "  average depth: " << st.average_depth << std::endl
+            << "  expected depth: " << st.expected_depth << std::endl
+            << "  boundary lists: " << st.boundary_total << " cells, "
+            << st.boundary_average << " average, " << st.boundary_max << " max" << std::endl
+            << "  memory: " << st.node_bytes / 1024 << " kB nodes, "
+            << st.cell_bytes / 1024 << " kB cells" << std::endl;
+    }
+
+    const QueryStats &qs = md.queries;
+    if (qs.queries) {
+        std::cout << "  since last stats, " << qs.queries << " queries tested per query:" << std::endl
+            << "    planes: " << double(qs.planes) / qs.queries << std::endl
+            << "    exact side tests: " << double(qs.exact) / qs.queries << std::endl
+            << "    cells: " << double(qs.containment) / qs.queries << std::endl;
+        md.queries = QueryStats();
+    }
+}
+
+void save(std::istringstream &iss, const MenuData &md) {
+    std::string filename;
+    if (!(iss >> filename)) {
+        error("Invalid input!");
+        std::cout << "Usage: " << SAVE << " filename" << std::endl;
+        return;
+    }
+
+    try {
+        std::cout << "Saving BSP tree... " << std::flush;
+        md.frozen.save(filename);
+        std::cout << "Done." << std::endl;
+    } catch (const std::runtime_error &e) {
+        error(e.what());
+    }
+}
+
+void load(const std::string &filename, MenuData &md) {
+    try {
+        std::cout << "Loading BSP tree... " << std::flush;
+        FrozenBSPTree frozen = FrozenBSPTree::load(filename);
+        md.bsp.clear();
+        md.polys.clear();
+        md.frozen = std::move(frozen);
+        md.loaded = true;
+        std::cout << "Done." << std::endl;
+    } catch (const std::runtime_error &e) {
+        error(e.what());
+    }
+}
+
+void locate(std::istringstream &iss, MenuData &md) {
     Point_3 p;
     if (!(iss >> p)) {
         error("Invalid input!");
@@ -143,13 +327,20 @@ void locate(std::istringstream &iss, const MenuData &md) {
         return;
     }
 
-    Polyhedron_3 poly;
-    if (!md.bsp.locate(p, poly)) {
+    int id = md.frozen.locate(p, md.queries);
+    if (id < 0) {
         std::cout << "Location failed!" << std::endl;
         return;
     }
 
-    std::cout << "Located in Polyhedron#" << poly.id() << std::endl;
+    std::cout << "Located in Polyhedron#" << id << std::endl;
+
+    // a loaded tree has no meshes
+    auto found = md.polys.find(id);
+    if (found == md.polys.end())
+        return;
+
+    const Polyhedron_3 *poly = &found->second;
 
     std::string filename;
     if (iss >> filename) {
@@ -160,17 +351,107 @@ void locate(std::istringstream &iss, const MenuData &md) {
         }
         else {
             std::cout << "Outputting to file '" << filename << "'...";
-            fout << poly;
+            fout << *poly;
             std::cout << " Done." << std::endl;
             return;
         }
     }
 
     std::cout << "Outputting to console..." << std::endl;
-    std::cout << poly << std::endl;
+    std::cout << *poly << std::endl;
     std::cout << "Done." << std::endl;
 }
 
+void ray(std::istringstream &iss, const MenuData &md) {
+    Point_3 p, q;
+    if (!(iss >> p >> q)) {
+        error("Invalid input!");
+        std::cout << "Usage: " << RAY << " x y z x y z" << std::endl
+            << "  x, y, z - coordinates of the ends of the segment" << std::endl;
+        return;
+    }
+
+    if (reject_loaded(RAY, md))
+        return;
+    if (md.bsp.empty()) {
+        std::cout << "No polyhedra to trace!" << std::endl;
+        return;
+    }
+
+    std::vector<BSPTree::Hit> hits = md.bsp.trace(K::Segment_3(p, q));
+    if (hits.empty()) {
+        std::cout << "No polyhedron met." << std::endl;
+        return;
+    }
+
+    for (const BSPTree::Hit &hit : hits) {
+        std::cout << "  Polyhedron#" << hit.poly->id() << " from "
+            << CGAL::to_double(hit.enter) << " to " << CGAL::to_double(hit.exit) << std::endl;
+    }
+}
+
+void range(std::istringstream &iss, const MenuData &md) {
+    std::vector<K::FT> c;
+    K::FT value;
+    while (iss >> value)
+        c.push_back(value);
+    if (c.size() != 6 && c.size() != 4) {
+        error("Invalid input!");
+        std::cout << "Usage: " << RANGE << " (x y z x y z | a b c d)" << std::endl
+            << "  x, y, z - coordinates of opposite corners of the box" << std::endl
+            << "  a, b, c, d - coefficients of the plane bounding the half-space" << std::endl;
+        return;
+    }
+
+    if (reject_loaded(RANGE, md))
+        return;
+    if (md.bsp.empty()) {
+        std::cout << "No polyhedra to search!" << std::endl;
+        return;
+    }
+
+    std::vector<int> ids;
+    if (c.size() == 6)
+        md.bsp.range(K::Iso_cuboid_3(Point_3(c[0], c[1], c[2]), Point_3(c[3], c[4], c[5])), std::back_inserter(ids));
+    else if (c[0] == 0 && c[1] == 0 && c[2] == 0) {
+        error("Degenerate plane!");
+        return;
+    }
+    else md.bsp.range(Plane_3(c[0], c[1], c[2], c[3]), std::back_inserter(ids));
+
+    std::sort(ids.begin(), ids.end());
+    std::cout << ids.size() << " polyhedra:";
+    for (int id : ids)
+        std::cout << " #" << id;
+    std::cout << std::endl;
+}
+
+void near(std::istringstream &iss, const MenuData &md) {
+    Point_3 p;
+    if (!(iss >> p)) {
+        error("Invalid input!");
+        std::cout << "Usage: " << NEAR << " x y z [k]" << std::endl
+            << "  x, y, z - coordinates of the point" << std::endl
+            << "  k - number of polyhedra to list" << std::endl;
+        return;
+    }
+
+    std::size_t k;
+    if (!(iss >> k))
+        k = 1;
+
+    if (reject_loaded(NEAR, md))
+        return;
+    if (md.bsp.empty()) {
+        std::cout << "No polyhedra to search!" << std::endl;
+        return;
+    }
+
+    for (const BSPTree::Near &near : md.bsp.nearest(p, k)) {
+        std::cout << "  Polyhedron#" << near.poly->id() << " at " << near.distance << std::endl;
+    }
+}
+
 void new_bsp(std::istringstream &iss, MenuData &md) {
     int h, w, d;
     if (iss >> h >> w >> d) {
@@ -182,14 +463,14 @@ void new_bsp(std::istringstream &iss, MenuData &md) {
 
         try {
             std::cout << "Building BSP tree... " << std::flush;
-            md.bsp = BSPTree(polys);
+            md.polys.clear();
+            md.bsp.rebuild(polys, md.options);
             std::cout << "Done." << std::endl;
 
-            md.polys.clear();
             for (const Polyhedron_3 &poly : polys) {
                 md.polys[poly.id()] = poly;
             }
-        } catch (std::runtime_error e) {
+        } catch (const std::runtime_error &e) {
             error(e.what());
         }
 
@@ -206,49 +487,57 @@ void new_bsp(std::istringstream &iss, MenuData &md) {
         return;
     }
 
-    std::ifstream ifs(filename.c_str());
-    if (!ifs) {
-        error("Cannot open file '" + filename + "'!");
+    std::uint64_t hash;
+    try {
+        hash = content_hash(filename);
+    } catch (const std::runtime_error &e) {
+        error(e.what());
         return;
     }
 
-    typedef CGAL::Nef_polyhedron_3<K> Nef_3;
-    typedef Nef_3::Volume_const_iterator Volume_const_iterator;
+    std::vector<Polyhedron_3> convex_parts;
+    std::string cache = filename + CELLS_SUFFIX;
+    if (!md.recompute && read_cells(cache, hash, convex_parts)) {
+        std::cout << "Using cached decomposition '" << cache << "'." << std::endl;
+    }
+    else {
+        std::ifstream ifs(filename.c_str());
+        if (!ifs) {
+            error("Cannot open file '" + filename + "'!");
+            return;
+        }
 
-    Nef_3 N;
-    std::cout << "Reading Nef Polyhedron from .off file... " << std::flush;
-    std::size_t discarded = CGAL::OFF_to_nef_3 (ifs, N, true);
-    std::cout << "Done." << std::endl;
+        std::cout << "Building convex decomposition... " << std::flush;
+        DecompositionStats ds;
+        try {
+            convex_decomposition(ifs, ds, [&](std::size_t, std::vector<Polyhedron_3> &&cells) {
+                std::move(cells.begin(), cells.end(), std::back_inserter(convex_parts));
+                std::cout << convex_parts.size() << "... " << std::flush;
+            }, md.options.threads);
+        } catch (const std::runtime_error &e) {
+            error(e.what());
+            return;
+        }
+        std::cout << "Done." << std::endl;
 
-    //std::cout << "Press Enter to proceed... ";
-    //std::getline(std::cin, filename);
+        std::cout << "  connected components: "
+            << ds.components << " in " << ds.groups << " groups" << std::endl;
 
-    std::cout << "  Nef vertices: "
-        << N.number_of_vertices() << std::endl;
-    std::cout << "  Nef edges: "
-        << N.number_of_edges() << std::endl;
-    std::cout << "  Nef facets: "
-        << N.number_of_facets() << std::endl;
-    std::cout << "  Nef volumes: "
-        << N.number_of_volumes() << std::endl;
-    std::cout << "  number of discarded facets: "
-        << discarded << std::endl;
-
-    std::cout << "Building convex decomposition... " << std::flush;
-    CGAL::convex_decomposition_3(N);
-    std::cout << "Done." << std::endl;
+        std::cout << "  Nef vertices: "
+            << ds.vertices << std::endl;
+        std::cout << "  Nef edges: "
+            << ds.edges << std::endl;
+        std::cout << "  Nef facets: "
+            << ds.facets << std::endl;
+        std::cout << "  Nef volumes: "
+            << ds.volumes << std::endl;
+        std::cout << "  number of discarded facets: "
+            << ds.discarded << std::endl;
 
-    std::vector<Polyhedron_3> convex_parts;
-    // the first volume is the outer volume, which is
-    // ignored in the decomposition
-    Volume_const_iterator ci = ++N.volumes_begin();
-    for( ; ci != N.volumes_end(); ++ci) {
-        if(ci->mark()) {
-            Polyhedron_3 P;
-            N.convert_inner_shell_to_polyhedron(ci->shells_begin(), P);
-            std::transform(P.facets_begin(), P.facets_end(), P.planes_begin(),
-                    Plane_equation());
-            convex_parts.push_back(P);
+        try {
+            write_cells(cache, hash, convex_parts);
+        } catch (const std::runtime_error &e) {
+            error(e.what());
         }
     }
 
@@ -262,12 +551,57 @@ void new_bsp(std::istringstream &iss, MenuData &md) {
 
     std::cout << "Building BSP tree... " << std::flush;
     try {
-        md.bsp = BSPTree(convex_parts);
+        md.bsp.rebuild(convex_parts, md.options);
         std::cout << "Done." << std::endl;
         for (const Polyhedron_3 &poly : convex_parts) {
             md.polys[poly.id()] = poly;
         }
-    } catch (std::runtime_error e) {
+    } catch (const std::runtime_error &e) {
+        error(e.what());
+        std::cout << "Clearing BSP tree..." << std::endl;
+        md.bsp.clear();
+        std::cout << "Done." << std::endl;
+    }
+}
+
+void new_cells(std::istringstream &iss, MenuData &md) {
+    std::string filename;
+    if (!(iss >> filename)) {
+        error("Invalid input!");
+        std::cout << "Usage: " << CELLS << " filename" << std::endl;
+        return;
+    }
+
+    std::ifstream ifs(filename.c_str());
+    if (!ifs) {
+        error("Cannot open file '" + filename + "'!");
+        return;
+    }
+
+    std::vector<Polyhedron_3> cells;
+    std::cout << "Reading convex cells... " << std::flush;
+    try {
+        OFFCellReader reader(ifs);
+        Polyhedron_3 P;
+        while (reader.next(P))
+            cells.push_back(std::move(P));
+    } catch (const std::runtime_error &e) {
+        error(e.what());
+        return;
+    }
+    std::cout << "Done." << std::endl;
+    std::random_shuffle(cells.begin(), cells.end());
+
+    md.polys.clear();
+
+    std::cout << "Building BSP tree of " << cells.size() << " cells... " << std::flush;
+    try {
+        md.bsp.rebuild(cells, md.options);
+        std::cout << "Done." << std::endl;
+        for (const Polyhedron_3 &poly : cells) {
+            md.polys[poly.id()] = poly;
+        }
+    } catch (const std::runtime_error &e) {
         error(e.what());
         std::cout << "Clearing BSP tree..." << std::endl;
         md.bsp.clear();
@@ -275,7 +609,10 @@ void new_bsp(std::istringstream &iss, MenuData &md) {
     }
 }
 
-void add(std::istringstream &iss, MenuData &md) {
+bool add(std::istringstream &iss, MenuData &md) {
+    if (reject_loaded(ADD, md))
+        return false;
+
     std::vector<Point_3> points;
     std::string filename;
     std::ifstream ifs;
@@ -310,65 +647,38 @@ void add(std::istringstream &iss, MenuData &md) {
         if (md.bsp.insert(P)) {
             std::cout << "Done." << std::endl;
             md.polys.insert(std::make_pair(P.id(), P));
+            return true;
         }
-        else {
-            error("Cannot add polyhedron due to its invalidity or various other reasons.");
-        }
-    } catch (std::runtime_error e) {
+        error("Cannot add polyhedron due to its invalidity or various other reasons.");
+    } catch (const std::runtime_error &e) {
         error(e.what());
     }
+    return false;
 }
 
-void rm(std::istringstream &iss, MenuData &md) {
+bool rm(std::istringstream &iss, MenuData &md) {
+    if (reject_loaded(REMOVE, md))
+        return false;
+
     int id;
     if (!(iss >> id)) {
         error("Invalid input!");
         std::cout << "Usage: " << REMOVE << " id" << std::endl;
-        return;
+        return false;
     }
 
     auto iter = md.polys.find(id);
     if (iter == md.polys.end()) {
         error("Cannot find id=" + std::to_string(id) + "!");
-        return;
+        return false;
     }
 
     std::cout << "Removing Polyhedron#" << iter->second.id() << "... " << std::flush;
     if (md.bsp.remove(iter->second)) {
         std::cout << "Done." << std::endl;
         md.polys.erase(iter);
+        return true;
     }
-    else {
-        error("Cannot remove polyhedron.");
-    }
-}
-
-
-Polyhedron_3 cube(const Point_3 &p, const CGAL::Gmpq &h,
-        const CGAL::Gmpq &w, const CGAL::Gmpq &d) {
-    std::vector<Point_3> points;
-    for (auto &x: {p.x(), p.x() + h})
-        for (auto &y: {p.y(), p.y() + w})
-            for (auto &z: {p.z(), p.z() + d})
-                points.push_back(Point_3(x, y, z));
-
-    Polyhedron_3 P;
-    CGAL::convex_hull_3(points.begin(), points.end(), P);
-    std::transform(P.facets_begin(), P.facets_end(), P.planes_begin(),
-            Plane_equation());
-
-    return P;
-
-}
-
-void cubes(unsigned int hn, unsigned int wn, unsigned int dn,
-        std::vector<Polyhedron_3> &v) {
-    v.clear();
-    for (int x = 0; x <= hn; ++x) {
-        for (int y = 0; y <= wn; ++y) {
-            for (int z = 0; z <= dn; ++z) {
-                v.push_back(cube(Point_3(x, y, z), 1, 1, 1));
-            }
-        }
-    }
+    error("Cannot remove polyhedron.");
+    return false;
 }
@@ -0,0 +1,87 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A whole file mapped read-only into memory for as long as the object
+// lives. Pages are loaded on first access, so opening is cheap whatever the
+// size of the file.
+class MappedFile {
+    const char *_data;
+    std::size_t _size;
+
+    void unmap() {
+        if (_data)
+            munmap(const_cast<char*>(_data), _size);
+        _data = NULL;
+        _size = 0;
+    }
+
+    public:
+
+        MappedFile() : _data(NULL), _size(0) {}
+
+        explicit MappedFile(const std::string &filename) : _data(NULL), _size(0) {
+            int fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("Cannot open file '" + filename + "'!");
+
+            struct stat st;
+            if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+                close(fd);
+                throw std::runtime_error("Cannot map file '" + filename + "'!");
+            }
+
+            void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (data == MAP_FAILED)
+                throw std::runtime_error("Cannot map file '" + filename + "'!");
+
+            _data = static_cast<const char*>(data);
+            _size = st.st_size;
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile(MappedFile &&other) : _data(other._data), _size(other._size) {
+            other._data = NULL;
+            other._size = 0;
+        }
+
+        MappedFile& operator=(MappedFile &&other) {
+            if (this != &other) {
+                unmap();
+                _data = other._data;
+                _size = other._size;
+                other._data = NULL;
+                other._size = 0;
+            }
+            return *this;
+        }
+
+        ~MappedFile() {
+            unmap();
+        }
+
+        const char* data() const {
+            return _data;
+        }
+
+        std::size_t size() const {
+            return _size;
+        }
+
+        bool empty() const {
+            return !_data;
+        }
+};
+
+#endif // MAPPED_FILE_H
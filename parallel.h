@@ -0,0 +1,66 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use when the caller passes 0.
+inline unsigned default_threads() {
+    unsigned threads = std::thread::hardware_concurrency();
+    return threads ? threads : 1;
+}
+
+// Calls body(begin, end) for consecutive chunks of [0, n) of at most `grain`
+// elements on `threads` threads (0 means one per core). Threads claim chunks
+// from a shared counter, so threads that finish early take over the
+// remaining work of slower ones. The first exception thrown by body is
+// rethrown once all threads have joined.
+template <class Body>
+void parallel_for(std::size_t n, std::size_t grain, unsigned threads, const Body &body) {
+    if (!threads)
+        threads = default_threads();
+    grain = std::max<std::size_t>(grain, 1);
+
+    std::size_t chunks = (n + grain - 1) / grain;
+    threads = (unsigned) std::min<std::size_t>(threads, chunks);
+    if (threads <= 1) {
+        for (std::size_t begin = 0; begin < n; begin += grain)
+            body(begin, std::min(n, begin + grain));
+        return;
+    }
+
+    std::atomic<std::size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&]() {
+        try {
+            for (std::size_t chunk = next++; chunk < chunks; chunk = next++) {
+                std::size_t begin = chunk * grain;
+                body(begin, std::min(n, begin + grain));
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error)
+                error = std::current_exception();
+            next = chunks;
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; ++i)
+        pool.push_back(std::thread(worker));
+    worker();
+    for (std::thread &thread : pool)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+#endif // PARALLEL_H
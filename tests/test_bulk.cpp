@@ -0,0 +1,80 @@
+// Bulk insert and remove must count only the polyhedra they change, skip
+// repeated polyhedra and polyhedra already in the tree or not in it, answer
+// queries as a tree grown one polyhedron at a time does, and collapse the
+// subtrees they empty.
+
+#include <set>
+#include <vector>
+
+#include "bsp.h"
+#include "cubes.h"
+#include "testing.h"
+
+// Checks both trees against the exact containment test on the cube
+// centres and corners; at the centres they must find the same polyhedron.
+void same_answers(const std::vector<Polyhedron_3> &cells, const BSPTree &bulk, const BSPTree &single,
+        const char *what) {
+    const CGAL::Gmpq half(1, 2);
+    for (int x = 0; x <= 4; ++x) {
+        for (int y = 0; y <= 4; ++y) {
+            for (int z = 0; z <= 4; ++z) {
+                Point_3 corner(x, y, z), centre(x + half, y + half, z + half);
+                std::set<int> exact = containing(cells, corner);
+                const Polyhedron_3 *b = bulk.locate(corner), *s = single.locate(corner);
+                check(located(exact, b ? b->id() : -1) && located(exact, s ? s->id() : -1), what);
+
+                exact = containing(cells, centre);
+                b = bulk.locate(centre);
+                s = single.locate(centre);
+                check(located(exact, b ? b->id() : -1) && (b ? b->id() : -1) == (s ? s->id() : -1), what);
+            }
+        }
+    }
+}
+
+int main() {
+    std::vector<Polyhedron_3> cells;
+    cubes(3, 3, 3, cells);
+    BSPTree single;
+    for (const Polyhedron_3 &poly : cells)
+        check(single.insert(poly), "insert one at a time");
+
+    // the first half builds the tree, the second half and repeats of both
+    // go in at once
+    std::size_t half = cells.size() / 2;
+    BSPTree bulk(std::vector<Polyhedron_3>(cells.begin(), cells.begin() + half));
+    std::vector<Polyhedron_3> batch(cells.begin() + half, cells.end());
+    batch.push_back(cells[half]);
+    batch.push_back(cells[0]);
+    check(bulk.insert(batch) == cells.size() - half, "bulk insert counts new polyhedra only");
+    check(bulk.cells().size() == cells.size(), "every polyhedron is stored once");
+    check(bulk.insert(cells) == 0, "a bulk insert of stored polyhedra changes nothing");
+    same_answers(cells, bulk, single, "bulk insert answers as single inserts");
+
+    // cubes() runs over x slowest, so the second half are the cubes with
+    // x >= 2; they go twice over, with a cube that was never inserted
+    std::vector<Polyhedron_3> kept(cells.begin(), cells.begin() + half),
+        removed(cells.begin() + half, cells.end());
+    batch = removed;
+    batch.insert(batch.end(), removed.begin(), removed.end());
+    batch.push_back(cube(Point_3(10, 10, 10), 1, 1, 1));
+    check(bulk.remove(batch) == removed.size(), "bulk remove counts stored polyhedra once");
+    check(bulk.remove(removed) == 0, "a bulk remove of removed polyhedra changes nothing");
+    for (const Polyhedron_3 &poly : removed)
+        single.remove(poly);
+    same_answers(kept, bulk, single, "bulk remove answers as single removes");
+
+    // no cube crosses a plane of the grid, so the tree is left with one
+    // leaf per cube and no emptied subtree
+    TreeStats stats = bulk.stats();
+    check(stats.leaves == kept.size() && stats.nodes == 2 * kept.size() - 1, "emptied subtrees collapse");
+
+    check(bulk.remove(cells) == kept.size(), "bulk remove of everything");
+    check(bulk.empty() && bulk.stats().nodes == 0 && bulk.cells().size() == 0, "the emptied tree has no nodes");
+    check(bulk.insert(cells) == cells.size(), "bulk insert into the emptied tree");
+    for (const Polyhedron_3 &poly : removed)
+        single.insert(poly);
+    same_answers(cells, bulk, single, "bulk insert after emptying");
+
+    return status();
+}
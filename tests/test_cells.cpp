@@ -0,0 +1,59 @@
+// OFFCellReader must take convex cells whatever the winding of their
+// facets, and reject cells with a facet that is not planar, whether or not
+// the cell is still convex.
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "decomposition.h"
+#include "testing.h"
+
+// A unit cube with its facets wound counter-clockwise seen from outside,
+// or clockwise, and the given z of vertex 7; any other z bends its three
+// facets.
+std::string cube_off(bool clockwise, const std::string &top = "1") {
+    std::string facets[6] = { "0 2 3 1", "4 5 7 6", "0 1 5 4", "2 6 7 3", "0 4 6 2", "1 3 7 5" };
+    std::ostringstream off;
+    off << "OFF\n8 6 0\n"
+        << "0 0 0\n1 0 0\n0 1 0\n1 1 0\n0 0 1\n1 0 1\n0 1 1\n1 1 " << top << "\n";
+    for (const std::string &facet : facets) {
+        std::string corners = facet;
+        if (clockwise)
+            corners = std::string(facet.rbegin(), facet.rend());
+        off << "4 " << corners << "\n";
+    }
+    return off.str();
+}
+
+// Whether the reader takes the only cell of the text.
+bool reads(const std::string &text) {
+    std::istringstream in(text);
+    OFFCellReader reader(in);
+    Polyhedron_3 P;
+    try {
+        return reader.next(P) && P.size_of_facets() == 6;
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+}
+
+int main() {
+    check(reads(cube_off(false)), "counter-clockwise facets");
+    check(reads(cube_off(true)), "clockwise facets");
+    // whichever three corners the plane of a bent facet is taken from, the
+    // fourth is off it
+    check(!reads(cube_off(false, "2")), "a facet that is not planar");
+    check(!reads(cube_off(false, "1/2")), "a facet that is not planar and dents the cell");
+    check(!reads(cube_off(true, "1/2")), "a clockwise facet that is not planar");
+
+    std::istringstream in(cube_off(true) + cube_off(false));
+    OFFCellReader reader(in);
+    Polyhedron_3 P;
+    check(reader.next(P) && reader.next(P) && !reader.next(P) && reader.count() == 2, "concatenated cells");
+    BSPTree bsp({ P });
+    const Polyhedron_3 *found = bsp.locate(Point_3(CGAL::Gmpq(1, 2), CGAL::Gmpq(1, 2), CGAL::Gmpq(1, 2)));
+    check(found && found->id() == P.id(), "the cell read is located");
+
+    return status();
+}
@@ -0,0 +1,131 @@
+// A corrupted tree file must be rejected by load() or answer queries
+// without reading outside its arrays; run under a sanitizer to catch the
+// latter. Every 32-bit word of a saved file is overwritten in turn, which
+// hits the counts, offsets, indices and exact coefficients alike. An exact
+// coefficient that does not read back as a number, or has a zero
+// denominator, must be rejected by load().
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bsp.h"
+#include "cubes.h"
+#include "testing.h"
+
+const std::string filename = "test_frozen_load.tree";
+
+void write_file(const std::string &contents) {
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    out.write(contents.data(), contents.size());
+}
+
+std::string read_file() {
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+bool loads(const std::string &contents) {
+    write_file(contents);
+    try {
+        FrozenBSPTree::load(filename);
+    } catch (const std::runtime_error &) {
+        return false;
+    }
+    return true;
+}
+
+void corrupted_words() {
+    std::vector<Polyhedron_3> cells;
+    BSPTree bsp;
+    cube_grid(1, cells, bsp);
+    FrozenBSPTree(bsp).save(filename);
+    const std::string contents = read_file();
+
+    const CGAL::Gmpq half(1, 2);
+    std::vector<Point_3> points;
+    for (int x = 0; x <= 2; ++x) {
+        for (int y = 0; y <= 2; ++y) {
+            for (int z = 0; z <= 2; ++z) {
+                points.push_back(Point_3(x, y, z));
+                points.push_back(Point_3(x + half, y + half, z + half));
+            }
+        }
+    }
+
+    FrozenBSPTree loaded = FrozenBSPTree::load(filename);
+    for (const Point_3 &p : points) {
+        const Polyhedron_3 *found = bsp.locate(p);
+        check(loaded.locate(p) == (found ? found->id() : -1), "the saved tree answers as the tree");
+    }
+
+    for (std::size_t length : { std::size_t(0), std::size_t(16), contents.size() / 2, contents.size() - 1 })
+        check(!loads(contents.substr(0, length)), "a truncated file is rejected");
+
+    std::size_t rejected = 0, words = 0;
+    std::vector<int> ids(points.size());
+    for (std::size_t offset = 0; offset + 4 <= contents.size(); offset += 4) {
+        for (std::uint32_t value : { std::uint32_t(0x7fffffff), std::uint32_t(0xfffffff0) }) {
+            std::string corrupted = contents;
+            corrupted.replace(offset, 4, reinterpret_cast<const char*>(&value), 4);
+            write_file(corrupted);
+            ++words;
+            try {
+                FrozenBSPTree tree = FrozenBSPTree::load(filename);
+                for (const Point_3 &p : points)
+                    tree.locate(p);
+                tree.locate_batch(points.data(), points.size(), ids.data());
+            } catch (const std::runtime_error &) {
+                ++rejected;
+            }
+        }
+    }
+    check(rejected > 0, "corrupted files are rejected");
+    std::cout << rejected << " of " << words << " corrupted files rejected" << std::endl;
+}
+
+// The exact coefficients of the kernel of the test are written as their
+// length followed by "n/d"; thirds make sure that some have a denominator.
+void corrupted_numbers() {
+    const CGAL::Gmpq third(1, 3);
+    BSPTree bsp({ cube(Point_3(third, third, third), 1, 1, 1), cube(Point_3(1 + third, third, third), 1, 1, 1) });
+    FrozenBSPTree(bsp).save(filename);
+    const std::string contents = read_file();
+    check(loads(contents), "the saved tree loads");
+
+    std::size_t found = std::string::npos;
+    std::uint32_t length = 0;
+    for (std::size_t offset = 0; offset + 4 < contents.size() && found == std::string::npos; ++offset) {
+        std::memcpy(&length, contents.data() + offset, 4);
+        if (length < 3 || length > 64 || offset + 4 + length > contents.size())
+            continue;
+        std::string text = contents.substr(offset + 4, length);
+        if (text.find('/') != std::string::npos && text.find_first_not_of("-0123456789/") == std::string::npos)
+            found = offset + 4;
+    }
+    check(found != std::string::npos, "a rational coefficient is found");
+    if (found == std::string::npos)
+        return;
+
+    std::string corrupted = contents;
+    corrupted[found + (contents[found] == '-')] = 'x';
+    check(!loads(corrupted), "a coefficient that is not a number is rejected");
+
+    corrupted = contents;
+    for (std::size_t i = contents.find('/', found) + 1; i < found + length; ++i)
+        corrupted[i] = '0';
+    check(!loads(corrupted), "a zero denominator is rejected");
+}
+
+int main() {
+    corrupted_words();
+    corrupted_numbers();
+    std::remove(filename.c_str());
+    return status();
+}
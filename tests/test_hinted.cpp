@@ -0,0 +1,62 @@
+// locate() with a hint must answer as locate() without one whether the hint
+// contains the point, is a cell some way off, or has been removed from the
+// tree; only the work done to find the answer may differ.
+
+#include <set>
+#include <vector>
+
+#include "bsp.h"
+#include "testing.h"
+
+int id(const Polyhedron_3 *poly) {
+    return poly ? poly->id() : -1;
+}
+
+int main() {
+    std::vector<Polyhedron_3> cells;
+    BSPTree bsp;
+    cube_grid(3, cells, bsp);
+
+    // the cube centres, facets, edges and corners, and points around them
+    const CGAL::Gmpq half(1, 2);
+    std::vector<Point_3> points;
+    for (int x = -1; x <= 9; ++x) {
+        for (int y = -1; y <= 9; ++y) {
+            for (int z = -1; z <= 9; ++z)
+                points.push_back(Point_3(x * half, y * half, z * half));
+        }
+    }
+
+    // cells[21] is the cube at (1, 1, 1), cells[63] the one at (3, 3, 3)
+    QueryStats correct, stale;
+    std::size_t inside = 0;
+    for (const Point_3 &p : points) {
+        std::set<int> exact = containing(cells, p);
+        const Polyhedron_3 *found = bsp.locate(p);
+        check(located(exact, id(found)), "locate");
+        check(id(bsp.locate(p, found, correct)) == id(found), "locate with the cell found as hint");
+        check(located(exact, id(bsp.locate(p, &cells[21], stale))), "locate with a stale hint");
+        check(located(exact, id(bsp.locate(p, &cells[63]))), "locate with a hint far from the point");
+        check(located(exact, id(bsp.locate(p, static_cast<const Polyhedron_3*>(NULL)))),
+                "locate with a NULL hint");
+        inside += found != NULL;
+    }
+    check(correct.hinted == inside && correct.hint_hits == inside, "a hint containing the point is taken");
+    check(stale.hint_hits > 0 && stale.walk_hits > 0, "a stale hint is walked from");
+
+    // the hint is only a copy of the removed cube, which the tree no
+    // longer knows
+    check(bsp.remove(cells[21]), "remove the hint");
+    std::vector<Polyhedron_3> left(cells);
+    left.erase(left.begin() + 21);
+    QueryStats removed;
+    for (const Point_3 &p : points) {
+        const Polyhedron_3 *found = bsp.locate(p, &cells[21], removed);
+        check(located(containing(left, p), id(found)) && id(found) == id(bsp.locate(p)),
+                "locate with a removed hint");
+    }
+    check(removed.hinted == points.size() && removed.hint_hits == 0 && removed.walk_hits == 0,
+            "a removed hint is not walked from");
+
+    return status();
+}
@@ -0,0 +1,78 @@
+// Inserting a polyhedron that overlaps cells of the tree must leave the
+// tree as it was, whatever the depth at which the overlap is found.
+// Removing a polyhedron that crosses a splitting plane must remove it from
+// both sides, down to the last two leaves under the root.
+
+#include <stdexcept>
+#include <vector>
+
+#include "bsp.h"
+#include "cubes.h"
+#include "testing.h"
+
+void overlapping() {
+    std::vector<Polyhedron_3> cells;
+    BSPTree bsp;
+    cube_grid(3, cells, bsp);
+    check(bsp.stats().max_depth > 2, "the tree has several levels");
+
+    const CGAL::Gmpq half(1, 2);
+    // straddles eight cubes and reaches out of the grid
+    Polyhedron_3 overlapping = cube(Point_3(3 + half, 1 + half, 1 + half), 1, 1, 1);
+    bool thrown = false;
+    try {
+        bsp.insert(overlapping);
+    } catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    check(thrown, "insert throws");
+    check(bsp.cells().size() == cells.size(), "the polyhedron is not stored");
+    check(!bsp.locate(Point_3(4 + half / 2, 2, 2)), "no polyhedron outside the grid");
+
+    // in the order of cubes()
+    std::size_t i = 0;
+    for (int x = 0; x <= 3; ++x) {
+        for (int y = 0; y <= 3; ++y) {
+            for (int z = 0; z <= 3; ++z) {
+                const Polyhedron_3 *found = bsp.locate(Point_3(x + half, y + half, z + half));
+                check(found && found->id() == cells[i++].id(), "cells are located as before");
+            }
+        }
+    }
+
+    check(!bsp.remove(overlapping), "the polyhedron cannot be removed");
+
+    // the tree still takes polyhedra
+    Polyhedron_3 next = cube(Point_3(4, 0, 0), 1, 1, 1);
+    check(bsp.insert(next), "insert after a failed one");
+    const Polyhedron_3 *found = bsp.locate(Point_3(4 + half, half, half));
+    check(found && found->id() == next.id(), "the new polyhedron is located");
+    check(bsp.remove(next), "the new polyhedron is removed");
+    check(bsp.cells().size() == cells.size(), "size after remove");
+}
+
+void crossing_root() {
+    const CGAL::Gmpq half(1, 2);
+    // a and b are split by a plane that crossing crosses
+    Polyhedron_3 a = cube(Point_3(0, 0, 0), 1, 1, 1), b = cube(Point_3(2, 0, 0), 1, 1, 1),
+        crossing = cube(Point_3(half, 1, 0), 2, 1, 1);
+    BSPTree bsp;
+    check(bsp.insert(a) && bsp.insert(b) && bsp.insert(crossing), "inserts next to each other");
+    const Polyhedron_3 *found = bsp.locate(Point_3(2, 1 + half, half));
+    check(found && found->id() == crossing.id(), "the crossing polyhedron is located");
+
+    check(bsp.remove(a) && bsp.remove(b), "the split polyhedra are removed");
+    found = bsp.locate(Point_3(1 + half, 1 + half, half));
+    check(found && found->id() == crossing.id(), "the crossing polyhedron is left");
+
+    check(bsp.remove(crossing), "the crossing polyhedron is removed");
+    check(bsp.empty() && bsp.cells().size() == 0, "the tree is empty");
+    check(!bsp.locate(Point_3(1 + half, 1 + half, half)), "nothing is located");
+    check(bsp.insert(a), "insert into the emptied tree");
+}
+
+int main() {
+    overlapping();
+    crossing_root();
+    return status();
+}
@@ -0,0 +1,59 @@
+// The filtered paths of locate(), locate_batch() and the frozen tree must
+// answer as the exact containment test does. The grid includes points on
+// the cell facets and points off them by less than a double can resolve,
+// which the double filter has to hand to the exact predicates. Batches
+// spread over several threads must answer as on one.
+
+#include <set>
+#include <vector>
+
+#include "bsp.h"
+#include "testing.h"
+
+int main() {
+    std::vector<Polyhedron_3> cells;
+    BSPTree bsp;
+    cube_grid(2, cells, bsp);
+    FrozenBSPTree frozen(bsp);
+
+    // 2^-60 vanishes next to 1 in a double
+    const CGAL::Gmpq half(1, 2), tiny = CGAL::Gmpq(1, 1 << 30) * CGAL::Gmpq(1, 1 << 30);
+    std::vector<CGAL::Gmpq> coordinates;
+    for (int k = -1; k <= 7; ++k)
+        coordinates.push_back(k * half);
+    for (int k = 0; k <= 3; ++k) {
+        coordinates.push_back(k + tiny);
+        coordinates.push_back(k - tiny);
+    }
+
+    std::vector<Point_3> points;
+    for (const CGAL::Gmpq &x : coordinates) {
+        for (const CGAL::Gmpq &y : coordinates) {
+            for (const CGAL::Gmpq &z : coordinates)
+                points.push_back(Point_3(x, y, z));
+        }
+    }
+
+    std::vector<int> ids(points.size()), threaded(points.size()),
+        frozen_ids(points.size()), frozen_threaded(points.size());
+    bsp.locate_batch(points.data(), points.size(), ids.data());
+    bsp.locate_batch(points.data(), points.size(), threaded.data(), 4);
+    frozen.locate_batch(points.data(), points.size(), frozen_ids.data());
+    frozen.locate_batch(points.data(), points.size(), frozen_threaded.data(), 4);
+
+    std::size_t found = 0;
+    for (std::size_t i = 0; i < points.size(); ++i) {
+        std::set<int> exact = containing(cells, points[i]);
+        const Polyhedron_3 *poly = bsp.locate(points[i]);
+        check(located(exact, poly ? poly->id() : -1), "locate");
+        check(located(exact, ids[i]), "locate_batch");
+        check(located(exact, frozen.locate(points[i])), "frozen locate");
+        check(located(exact, frozen_ids[i]), "frozen locate_batch");
+        check(threaded[i] == ids[i], "threaded locate_batch");
+        check(frozen_threaded[i] == frozen_ids[i], "threaded frozen locate_batch");
+        found += !exact.empty();
+    }
+    check(found > 0 && found < points.size(), "points inside and outside the cells");
+
+    return status();
+}
@@ -0,0 +1,145 @@
+// Ray, range and nearest queries on a grid of unit cubes, against the cubes
+// known to answer them.
+
+#include <cmath>
+#include <iterator>
+#include <set>
+#include <vector>
+
+#include "bsp.h"
+#include "testing.h"
+
+typedef BSPTree::Hit Hit;
+typedef BSPTree::Near Near;
+typedef K::Ray_3 Ray_3;
+typedef K::Segment_3 Segment_3;
+typedef K::Iso_cuboid_3 Iso_cuboid_3;
+
+std::vector<Polyhedron_3> cells;
+BSPTree bsp;
+const CGAL::Gmpq half(1, 2);
+
+// Id of the cube with lowest corner (x, y, z); cubes() runs over z fastest.
+int at(int x, int y, int z) {
+    return cells[16 * x + 4 * y + z].id();
+}
+
+void rays() {
+    // along the row of cubes at y = 0, z = 1 from outside the grid
+    Ray_3 row(Point_3(-1, half, 3 * half), Point_3(0, half, 3 * half));
+    std::vector<Hit> hits = bsp.trace(row);
+    check(hits.size() == 4, "a ray along a row meets its cubes");
+    for (std::size_t i = 0; i < hits.size() && i < 4; ++i) {
+        check(hits[i].poly->id() == at(i, 0, 1), "the cubes are met in order");
+        check(hits[i].enter == static_cast<int>(i) + 1 && hits[i].exit == static_cast<int>(i) + 2,
+                "where the ray enters and leaves them");
+    }
+    Hit first;
+    check(bsp.first_hit(row, first) && first.poly->id() == at(0, 0, 1) && first.enter == 1,
+            "the first cube met by the ray");
+
+    // the same row from inside the first cube to the middle of the third
+    Segment_3 segment(Point_3(half, half, 3 * half), Point_3(5 * half, half, 3 * half));
+    hits = bsp.trace(segment);
+    check(hits.size() == 3 && hits[0].poly->id() == at(0, 0, 1) && hits[1].poly->id() == at(1, 0, 1)
+            && hits[2].poly->id() == at(2, 0, 1), "a segment meets the cubes up to its end");
+    check(hits.size() == 3 && hits[1].enter == CGAL::Gmpq(1, 4) && hits[1].exit == CGAL::Gmpq(3, 4)
+            && hits[2].exit == 1, "where the segment enters and leaves them");
+
+    // back along the diagonal, from outside the far corner
+    Ray_3 diagonal(Point_3(5, 5, 5), Point_3(4, 4, 4));
+    check(bsp.first_hit(diagonal, first) && first.poly->id() == at(3, 3, 3) && first.enter == 1,
+            "the first cube met along the diagonal");
+
+    Ray_3 away(Point_3(-1, half, half), Point_3(-2, half, half));
+    check(bsp.trace(away).empty() && !bsp.first_hit(away, first), "a ray pointing away meets nothing");
+
+    Ray_3 batch[] = {row, diagonal, away};
+    int ids[3];
+    bsp.first_hit_batch(batch, 3, ids);
+    check(ids[0] == at(0, 0, 1) && ids[1] == at(3, 3, 3) && ids[2] == -1, "first_hit_batch");
+}
+
+// Ids of the cubes with lowest corners in [x0, x1] x [y0, y1] x [z0, z1].
+std::set<int> block(int x0, int x1, int y0, int y1, int z0, int z1) {
+    std::set<int> ids;
+    for (int x = x0; x <= x1; ++x) {
+        for (int y = y0; y <= y1; ++y) {
+            for (int z = z0; z <= z1; ++z)
+                ids.insert(at(x, y, z));
+        }
+    }
+    return ids;
+}
+
+template <class Region>
+std::set<int> range(const Region &region) {
+    std::vector<int> ids;
+    bsp.range(region, std::back_inserter(ids));
+    std::set<int> unique(ids.begin(), ids.end());
+    check(unique.size() == ids.size(), "range() reports each cube once");
+    return unique;
+}
+
+void ranges() {
+    check(range(Iso_cuboid_3(Point_3(half, half, half), Point_3(3 * half, 3 * half, 3 * half)))
+            == block(0, 1, 0, 1, 0, 1), "a box across eight cubes");
+    // closed boxes meet the cubes they touch, along an edge too
+    check(range(Iso_cuboid_3(Point_3(1, 1, 1), Point_3(2, 2, 2))) == block(0, 2, 0, 2, 0, 2),
+            "a box on the facets of a cube");
+    check(range(Iso_cuboid_3(Point_3(4, 0, 0), Point_3(5, 1, 1))) == block(3, 3, 0, 1, 0, 1),
+            "a box touching a cube from outside");
+    check(range(Iso_cuboid_3(Point_3(5, 5, 5), Point_3(6, 6, 6))).empty(), "a box off the grid");
+
+    // the closed negative sides of the planes x = 1 and x + y + z = 1
+    check(range(Plane_3(1, 0, 0, -1)) == block(0, 1, 0, 3, 0, 3), "the half-space x <= 1");
+    std::set<int> corner = block(0, 0, 0, 0, 0, 0);
+    corner.insert(at(1, 0, 0));
+    corner.insert(at(0, 1, 0));
+    corner.insert(at(0, 0, 1));
+    check(range(Plane_3(1, 1, 1, -1)) == corner, "the half-space x + y + z <= 1");
+    check(range(Plane_3(-1, 0, 0, -10)) == block(0, 3, 0, 3, 0, 3), "a half-space holding the grid");
+    check(range(Plane_3(1, 0, 0, 10)).empty(), "a half-space off the grid");
+}
+
+bool near(const Near &n, int id, double distance) {
+    return n.poly && n.poly->id() == id && std::abs(n.distance - distance) < 1e-9;
+}
+
+void nearest() {
+    // next to the middle of the facet x = 0 of the cube at the origin
+    Point_3 p(-1, half, half);
+    Near n;
+    check(bsp.nearest(p, n) && near(n, at(0, 0, 0), 1), "the nearest cube");
+    check(!bsp.nearest(p, n, 0.5), "no cube within the distance");
+
+    // then the two cubes sharing an edge of that facet, then the one
+    // sharing its corner
+    std::vector<Near> found = bsp.nearest(p, 4);
+    check(found.size() == 4, "the k nearest cubes");
+    if (found.size() == 4) {
+        check(near(found[0], at(0, 0, 0), 1), "the nearest first");
+        check((near(found[1], at(0, 1, 0), std::sqrt(1.25)) && near(found[2], at(0, 0, 1), std::sqrt(1.25)))
+                || (near(found[1], at(0, 0, 1), std::sqrt(1.25)) && near(found[2], at(0, 1, 0), std::sqrt(1.25))),
+                "then the cubes at the same distance");
+        check(near(found[3], at(0, 1, 1), std::sqrt(1.5)), "then the furthest");
+    }
+    found = bsp.nearest(p, 4, 1.1);
+    check(found.size() == 1 && near(found[0], at(0, 0, 0), 1), "the k nearest within the distance");
+    found = bsp.nearest(p, 1);
+    check(found.size() == 1 && near(found[0], at(0, 0, 0), 1), "the single nearest cube");
+
+    check(bsp.nearest(Point_3(5, 5, 5), n) && near(n, at(3, 3, 3), std::sqrt(3.0)),
+            "the nearest cube to a point off the corner of the grid");
+    found = bsp.nearest(Point_3(5 * half, half, 3 * half), 2);
+    check(found.size() == 2 && near(found[0], at(2, 0, 1), 0) && std::abs(found[1].distance - 0.5) < 1e-9,
+            "a cube containing the point is at distance 0");
+}
+
+int main() {
+    cube_grid(3, cells, bsp);
+    rays();
+    ranges();
+    nearest();
+    return status();
+}
@@ -0,0 +1,85 @@
+// A row of cubes inserted in order grows a path as deep as the row is long
+// unless insert() and remove() rebalance it. Through inserts and removes
+// in random order, on the row and on a cube grid, the tree must stay
+// within the depth scapegoat trees keep for the rebalancing fraction, with
+// some slack for the rebuilding waiting on enough updates, and locate()
+// must keep answering as the exact containment test does.
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "bsp.h"
+#include "cubes.h"
+#include "testing.h"
+
+bool shallow(const BSPTree &bsp, const BuildOptions &options) {
+    TreeStats stats = bsp.stats();
+    return stats.max_depth <= std::log(stats.leaves) / std::log(1 / options.rebalance_alpha) + 2;
+}
+
+// Checks the centres, facets and corners of the cubes of a grid of
+// cubes(n, w, w) and points around it.
+void check_locate(const std::vector<Polyhedron_3> &cells, const std::vector<bool> &stored,
+        unsigned n, unsigned w, const BSPTree &bsp) {
+    std::vector<Polyhedron_3> live;
+    for (std::size_t i = 0; i < cells.size(); ++i) {
+        if (stored[i])
+            live.push_back(cells[i]);
+    }
+
+    const CGAL::Gmpq half(1, 2);
+    for (int x = -1; x <= 2 * static_cast<int>(n) + 3; ++x) {
+        for (int y = -1; y <= 2 * static_cast<int>(w) + 3; ++y) {
+            for (int z = -1; z <= 2 * static_cast<int>(w) + 3; ++z) {
+                Point_3 p(x * half, y * half, z * half);
+                const Polyhedron_3 *poly = bsp.locate(p);
+                check(located(containing(live, p), poly ? poly->id() : -1), "locate after updates");
+            }
+        }
+    }
+}
+
+// Removes and reinserts cubes at random, checking the tree every so often.
+void churn(const std::vector<Polyhedron_3> &cells, unsigned n, unsigned w, BSPTree &bsp,
+        const BuildOptions &options) {
+    std::vector<bool> stored(cells.size(), true);
+    check_locate(cells, stored, n, w, bsp);
+
+    std::mt19937 random(1);
+    for (int round = 1; round <= 2000; ++round) {
+        std::size_t i = random() % cells.size();
+        stored[i] = !bsp.remove(cells[i]);
+        if (stored[i])
+            check(bsp.insert(cells[i]), "insert after remove");
+        if (round % 500 == 0) {
+            check(!bsp.empty() && shallow(bsp, options), "depth after inserts and removes");
+            check_locate(cells, stored, n, w, bsp);
+        }
+    }
+}
+
+int main() {
+    std::vector<Polyhedron_3> cells;
+    cubes(63, 0, 0, cells);
+    BuildOptions options;
+    BSPTree bsp(options);
+    for (const Polyhedron_3 &poly : cells)
+        bsp.insert(poly);
+    check(shallow(bsp, options), "depth after inserting in order");
+    churn(cells, 63, 0, bsp, options);
+
+    std::vector<Polyhedron_3> grid;
+    BSPTree cube_tree;
+    cube_grid(3, grid, cube_tree);
+    churn(grid, 3, 3, cube_tree, options);
+
+    // the row is a worst case without rebalancing
+    options.rebalance_alpha = 1;
+    BSPTree path(options);
+    for (const Polyhedron_3 &poly : cells)
+        path.insert(poly);
+    check(!shallow(path, BuildOptions()), "the row is deep without rebalancing");
+
+    return status();
+}
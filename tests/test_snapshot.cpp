@@ -0,0 +1,130 @@
+// A pinned snapshot must answer as the tree did when it was taken, whatever
+// is inserted or removed afterwards, and readers on other threads must only
+// ever see whole versions while a writer updates the tree.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "bsp.h"
+#include "cubes.h"
+#include "testing.h"
+
+const CGAL::Gmpq half(1, 2);
+
+// Centre of a unit cube: its lowest corner is below every other one.
+Point_3 centre(const Polyhedron_3 &poly) {
+    Point_3 p = *poly.points_begin();
+    for (auto v = poly.points_begin(); v != poly.points_end(); ++v) {
+        if (v->x() <= p.x() && v->y() <= p.y() && v->z() <= p.z())
+            p = *v;
+    }
+    return Point_3(p.x() + half, p.y() + half, p.z() + half);
+}
+
+int located_id(const SnapshotBSPTree::Snapshot &snapshot, const Point_3 &p) {
+    const Polyhedron_3 *poly = snapshot.locate(p);
+    return poly ? poly->id() : -1;
+}
+
+void pinned() {
+    std::vector<Polyhedron_3> cells;
+    cubes(2, 2, 2, cells);
+    SnapshotBSPTree tree(cells);
+    const Polyhedron_3 &gone = cells[13];
+    Polyhedron_3 added = cube(Point_3(3, 0, 0), 1, 1, 1);
+
+    std::shared_ptr<const SnapshotBSPTree::Snapshot> before = tree.snapshot();
+    check(tree.remove(gone), "remove from the live tree");
+    std::shared_ptr<const SnapshotBSPTree::Snapshot> removed = tree.snapshot();
+    check(tree.insert(added), "insert into the live tree");
+    check(!tree.remove(gone), "a removed polyhedron is not removed twice");
+    std::shared_ptr<const SnapshotBSPTree::Snapshot> after = tree.snapshot();
+
+    check(before->size() == cells.size() && removed->size() == cells.size() - 1
+            && after->size() == cells.size(), "sizes of the versions");
+    check(before->version() < removed->version() && removed->version() < after->version(),
+            "versions increase");
+
+    const Polyhedron_3 *kept = before->locate(centre(gone));
+    check(kept && kept->id() == gone.id(), "the pinned snapshot locates the removed polyhedron");
+    check(located_id(*removed, centre(gone)) == -1 && located_id(*after, centre(gone)) == -1,
+            "later versions do not");
+    check(located_id(*before, centre(added)) == -1 && located_id(*removed, centre(added)) == -1,
+            "earlier versions do not locate the inserted polyhedron");
+    check(located_id(*after, centre(added)) == added.id(), "the latest version does");
+
+    // reinserting it in the live tree leaves the pinned versions as they were
+    check(tree.insert(gone) && tree.remove(added), "update the live tree again");
+    check(located_id(*tree.snapshot(), centre(gone)) == gone.id(), "the reinserted polyhedron is located");
+    check(located_id(*removed, centre(gone)) == -1 && located_id(*after, centre(added)) == added.id(),
+            "pinned versions do not change");
+    check(before->locate(centre(gone)) == kept, "the pinned polyhedron is the same");
+    for (const Polyhedron_3 &poly : cells)
+        check(located_id(*before, centre(poly)) == poly.id(), "the pinned snapshot locates every polyhedron");
+}
+
+// A writer removes and reinserts the layer x = 2 of the cubes while readers
+// take snapshots: every cube outside the layer is always found, and the
+// cubes found in the layer are as many as the size of the snapshot says.
+void concurrent() {
+    std::vector<Polyhedron_3> cells, layer;
+    cubes(2, 2, 2, cells);
+    SnapshotBSPTree tree(cells);
+    std::vector<std::pair<Point_3, int> > fixed, changing;
+    for (const Polyhedron_3 &poly : cells) {
+        Point_3 p = centre(poly);
+        if (p.x() > 2) {
+            changing.push_back(std::make_pair(p, poly.id()));
+            layer.push_back(poly);
+        }
+        else fixed.push_back(std::make_pair(p, poly.id()));
+    }
+
+    std::atomic<bool> done(false);
+    std::vector<char> torn(4, 0), stale(4, 0);
+    std::vector<std::thread> readers;
+    for (std::size_t r = 0; r < torn.size(); ++r) {
+        readers.push_back(std::thread([&, r]() {
+            std::uint64_t last = 0;
+            do {
+                std::shared_ptr<const SnapshotBSPTree::Snapshot> snapshot = tree.snapshot();
+                stale[r] |= snapshot->version() < last;
+                last = snapshot->version();
+                std::size_t found = 0;
+                for (const std::pair<Point_3, int> &c : fixed)
+                    torn[r] |= located_id(*snapshot, c.first) != c.second;
+                for (const std::pair<Point_3, int> &c : changing) {
+                    int id = located_id(*snapshot, c.first);
+                    torn[r] |= id != -1 && id != c.second;
+                    found += id != -1;
+                }
+                torn[r] |= fixed.size() + found != snapshot->size();
+            } while (!done);
+        }));
+    }
+
+    bool updated = true;
+    for (int round = 0; round < 20; ++round) {
+        for (const Polyhedron_3 &poly : layer)
+            updated &= tree.remove(poly);
+        for (const Polyhedron_3 &poly : layer)
+            updated &= tree.insert(poly);
+    }
+    done = true;
+    for (std::thread &reader : readers)
+        reader.join();
+
+    check(updated, "the writer updates the tree");
+    for (std::size_t r = 0; r < torn.size(); ++r) {
+        check(!torn[r], "readers see whole versions");
+        check(!stale[r], "readers see versions in order");
+    }
+    check(tree.snapshot()->size() == cells.size(), "the writer leaves every polyhedron");
+}
+
+int main() {
+    pinned();
+    concurrent();
+    return status();
+}
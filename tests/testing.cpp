@@ -0,0 +1,37 @@
+#include <iostream>
+
+#include "cubes.h"
+#include "testing.h"
+
+namespace {
+    int failures = 0;
+}
+
+void check(bool condition, const char *what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+    }
+}
+
+int status() {
+    return failures ? 1 : 0;
+}
+
+void cube_grid(unsigned n, std::vector<Polyhedron_3> &cells, BSPTree &bsp) {
+    cubes(n, n, n, cells);
+    bsp.rebuild(cells, BuildOptions());
+}
+
+std::set<int> containing(const std::vector<Polyhedron_3> &cells, const Point_3 &p) {
+    std::set<int> ids;
+    for (const Polyhedron_3 &poly : cells) {
+        if (point_in_polyhedron(poly, p))
+            ids.insert(poly.id());
+    }
+    return ids;
+}
+
+bool located(const std::set<int> &ids, int id) {
+    return ids.empty() ? id == -1 : ids.count(id) == 1;
+}
@@ -0,0 +1,24 @@
+#ifndef TESTING_H
+#define TESTING_H
+
+#include <set>
+#include <vector>
+
+#include "bsp.h"
+
+// Reports the check if it failed. A test returns status() from main(),
+// which is 1 once any check has failed.
+void check(bool, const char*);
+int status();
+
+// Fills cells with the unit cubes of [0, n + 1]^3 in the order of cubes()
+// and builds the tree from them.
+void cube_grid(unsigned, std::vector<Polyhedron_3>&, BSPTree&);
+
+// Ids of the polyhedra containing the point by the exact test, and whether
+// an id found by a query is one of them, or -1 if there are none; any
+// polyhedron containing a point on a shared facet may be found.
+std::set<int> containing(const std::vector<Polyhedron_3>&, const Point_3&);
+bool located(const std::set<int>&, int);
+
+#endif // TESTING_H